@@ -104,7 +104,17 @@
 #include <syslog.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
+#include <poll.h>
 #include <clplumbing/cl_log.h>
+#include <rtcache.h>
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK	12
+#endif
+#endif
 
 
 #define PIDFILE_BASE HA_RSCTMPDIR  "/IPv6addr-"
@@ -174,6 +184,13 @@ static char* find_if(struct in6_addr* addr_target, int* plen_target, char* prov_
 static char* get_if(struct in6_addr* addr_target, int* plen_target, char* prov_ifname);
 static int assign_addr6(struct in6_addr* addr6, int prefix_len, char* if_name);
 static int unassign_addr6(struct in6_addr* addr6, int prefix_len, char* if_name);
+#ifdef HAVE_LINUX_RTNETLINK_H
+static int dad_open(void);
+static int dad_wait(int fd, struct in6_addr* addr6, char* if_name, int timeout_ms);
+#endif
+#ifndef HAVE_LINUX_RTNETLINK_H
+static int ioctl_addr6(int cmd, struct in6_addr* addr6, int prefix_len, char* if_name);
+#endif
 int is_addr6_available(struct in6_addr* addr6);
 
 int
@@ -316,6 +333,8 @@ start_addr6(struct in6_addr* addr6, int prefix_len, char* prov_ifname)
 {
 	int	i;
 	char*	if_name;
+	int	dad_fd = -1;
+	struct ua_packet ua;
 	if(OCF_SUCCESS == status_addr6(addr6,prefix_len,prov_ifname)) {
 		return OCF_SUCCESS;
 	}
@@ -327,28 +346,53 @@ start_addr6(struct in6_addr* addr6, int prefix_len, char* prov_ifname)
 		return OCF_ERR_GENERIC;
 	}
 
+#ifdef HAVE_LINUX_RTNETLINK_H
+	/* listen before assigning, the address may pass DAD at once */
+	dad_fd = dad_open();
+#endif
+
 	/* Assign the address */
 	if (0 != assign_addr6(addr6, prefix_len, if_name)) {
 		cl_log(LOG_ERR, "failed to assign the address to %s", if_name);
+		if (dad_fd >= 0) {
+			close(dad_fd);
+		}
 		return OCF_ERR_GENERIC;
 	}
 
-	/* Check whether the address available */
+#ifdef HAVE_LINUX_RTNETLINK_H
+	/* The address is usable as soon as DAD is over */
+	if (dad_fd >= 0) {
+		i = dad_wait(dad_fd, addr6, if_name, QUERY_COUNT * 1000);
+		close(dad_fd);
+		if (i < 0) {
+			/* don't leave it behind for status to find */
+			unassign_addr6(addr6, prefix_len, if_name);
+			return OCF_ERR_GENERIC;
+		}
+		goto advertise;
+	}
+#endif
+
+	/* Check whether the address available; each try waits up to
+	 * PROBE_TIMEOUT for an answer */
 	for (i = 0; i < QUERY_COUNT; i++) {
 		if (0 == is_addr6_available(addr6)) {
 			break;
 		}
-		sleep(1);
 	}
 	if (i == QUERY_COUNT) {
 		cl_log(LOG_ERR, "failed to ping the address");
 		return OCF_ERR_GENERIC;
 	}
 
+#ifdef HAVE_LINUX_RTNETLINK_H
+advertise:
+#endif
 	/* Send unsolicited advertisement packet to neighbor */
-	for (i = 0; i < UA_REPEAT_COUNT; i++) {
-		send_ua(addr6, if_name);
-		sleep(1);
+	if (ua_open(&ua, addr6, if_name) == 0) {
+		ua_send_repeat(&ua, UA_REPEAT_COUNT, 1000);
+		ua_close(&ua);
 	}
 	return OCF_SUCCESS;
 }
@@ -358,15 +402,15 @@ advt_addr6(struct in6_addr* addr6, int prefix_len, char* prov_ifname)
 {
 	/* First, we need to find a proper device to assign the address */
 	char*	if_name = get_if(addr6, &prefix_len, prov_ifname);
-	int	i;
+	struct ua_packet ua;
 	if (NULL == if_name) {
 		cl_log(LOG_ERR, "no valid mechanisms");
 		return OCF_ERR_GENERIC;
 	}
 	/* Send unsolicited advertisement packet to neighbor */
-	for (i = 0; i < UA_REPEAT_COUNT; i++) {
-		send_ua(addr6, if_name);
-		sleep(1);
+	if (ua_open(&ua, addr6, if_name) == 0) {
+		ua_send_repeat(&ua, UA_REPEAT_COUNT, 1000);
+		ua_close(&ua);
 	}
 	return OCF_SUCCESS;
 }
@@ -415,6 +459,393 @@ monitor_addr6(struct in6_addr* addr6, int prefix_len)
 	return OCF_NOT_RUNNING;
 }
 
+#ifdef HAVE_LINUX_RTNETLINK_H
+/*
+ * rtnetlink: addresses are added and removed with RTM_NEWADDR and
+ * RTM_DELADDR, and looked up in one RTM_GETADDR dump which the kernel
+ * filters by interface when it can (NETLINK_GET_STRICT_CHK).  One
+ * round trip each, however many addresses the host has.
+ */
+static int	rtnl_fd = -1;
+static unsigned	rtnl_seq;
+
+static int
+rtnl_send(struct nlmsghdr *nh)
+{
+	struct sockaddr_nl	nladdr;
+	int			one = 1;
+
+	if (rtnl_fd < 0) {
+		rtnl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC
+		,	NETLINK_ROUTE);
+		if (rtnl_fd < 0) {
+			return -errno;
+		}
+		/* older kernels ignore the dump filter, we check anyway */
+		setsockopt(rtnl_fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK
+		,	&one, sizeof(one));
+	}
+	nh->nlmsg_seq = ++rtnl_seq;
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(rtnl_fd, nh, nh->nlmsg_len, 0
+	,	(struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		return -errno;
+	}
+	return 0;
+}
+
+/* req is the whole request buffer, with the nlmsghdr at its start */
+static void
+rtnl_addattr(void *req, int type, const void *data, int len)
+{
+	struct nlmsghdr *nh = req;
+	struct rtattr *rta;
+
+	rta = (struct rtattr *)((char *)nh + NLMSG_ALIGN(nh->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/*
+ * Send a request and feed every reply message to cb (if any) until the
+ * request is done: NLMSG_DONE for a dump, the ACK otherwise.  A non-zero
+ * cb return stops a dump early.  Returns 0, or -errno from the kernel.
+ */
+static int
+rtnl_talk(struct nlmsghdr *req, int (*cb)(struct nlmsghdr *, void *)
+,	void *arg)
+{
+	static char	buf[32768];
+	struct nlmsghdr	*nh;
+	int	len, rc, dump = req->nlmsg_flags & NLM_F_DUMP;
+
+	if ((rc = rtnl_send(req)) < 0) {
+		return rc;
+	}
+	for (;;) {
+		len = recv(rtnl_fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned)len)
+		;	nh = NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_seq != rtnl_seq) {
+				continue;
+			}
+			if (nh->nlmsg_type == NLMSG_DONE) {
+				return 0;
+			}
+			if (nh->nlmsg_type == NLMSG_ERROR) {
+				return ((struct nlmsgerr *)NLMSG_DATA(nh))->error;
+			}
+			if (cb != NULL && cb(nh, arg) && dump) {
+				/* drain the rest of a dump we stop early */
+				while (recv(rtnl_fd, buf, sizeof(buf)
+				,	MSG_DONTWAIT) > 0)
+					;
+				return 0;
+			}
+		}
+	}
+}
+
+/* add (RTM_NEWADDR) or remove (RTM_DELADDR) addr6/prefix_len on if_name */
+static int
+rtnl_addr6(int cmd, struct in6_addr* addr6, int prefix_len, char* if_name)
+{
+	struct {
+		struct nlmsghdr		nh;
+		struct ifaddrmsg	ifa;
+		char			attrs[64];
+	} req;
+	int	ifindex, rc;
+
+	if ((ifindex = if_nametoindex(if_name)) == 0) {
+		cl_log(LOG_ERR, "no such interface: %s", if_name);
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+	req.nh.nlmsg_type = cmd;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	if (cmd == RTM_NEWADDR) {
+		req.nh.nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+	}
+	req.ifa.ifa_family = AF_INET6;
+	req.ifa.ifa_prefixlen = prefix_len;
+	req.ifa.ifa_index = ifindex;
+	rtnl_addattr(&req, IFA_LOCAL, addr6, sizeof(*addr6));
+	rtnl_addattr(&req, IFA_ADDRESS, addr6, sizeof(*addr6));
+
+	if ((rc = rtnl_talk(&req.nh, NULL, NULL)) < 0) {
+		cl_log(LOG_ERR, "%s address on %s: %s"
+		,	cmd == RTM_NEWADDR ? "adding" : "deleting"
+		,	if_name, strerror(-rc));
+		return -1;
+	}
+	return 0;
+}
+
+/* what scan_if() looks for, and what it found */
+struct addr6_scan {
+	struct in6_addr	*target;
+	int		plen;		/* 0 for any */
+	int		use_mask;	/* match the target's prefix */
+	int		ifindex;	/* 0 for any */
+	int		found_ifindex;
+	int		found_plen;
+};
+
+/* do the first plen bits of a and b agree? */
+static int
+prefix_equal(const struct in6_addr *a, const struct in6_addr *b, int plen)
+{
+	int	n = plen / 8, bits = plen % 8;
+
+	if (memcmp(a->s6_addr, b->s6_addr, n) != 0) {
+		return 0;
+	}
+	return bits == 0 || ((a->s6_addr[n] ^ b->s6_addr[n])
+	&	(0xff00 >> bits) & 0xff) == 0;
+}
+
+static int
+addr6_scan_cb(struct nlmsghdr *nh, void *arg)
+{
+	struct addr6_scan	*sc = arg;
+	struct ifaddrmsg	*ifa = NLMSG_DATA(nh);
+	struct rtattr		*rta;
+	struct in6_addr		*addr = NULL;
+	int	attrlen = IFA_PAYLOAD(nh);
+
+	if (nh->nlmsg_type != RTM_NEWADDR || ifa->ifa_family != AF_INET6
+	||	(sc->ifindex && (int)ifa->ifa_index != sc->ifindex)) {
+		return 0;
+	}
+	/* global addresses, and link-local ones only on a given interface,
+	 * as in /proc/net/if_inet6 below
+	 */
+	if (ifa->ifa_scope != RT_SCOPE_UNIVERSE
+	&&	(ifa->ifa_scope != RT_SCOPE_LINK || !sc->ifindex)) {
+		return 0;
+	}
+	if (sc->plen != 0 && ifa->ifa_prefixlen != sc->plen) {
+		return 0;
+	}
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == IFA_LOCAL
+		||	(rta->rta_type == IFA_ADDRESS && addr == NULL)) {
+			addr = RTA_DATA(rta);
+		}
+	}
+	if (addr == NULL || !prefix_equal(addr, sc->target
+	,	sc->use_mask ? ifa->ifa_prefixlen : 128)) {
+		return 0;
+	}
+	sc->found_ifindex = ifa->ifa_index;
+	sc->found_plen = ifa->ifa_prefixlen;
+	return 1;
+}
+
+/*
+ * scan_if() through one RTM_GETADDR dump: 1 with devname and
+ * *plen_target filled in if found, 0 if not, -1 if rtnetlink failed.
+ */
+static int
+scan_if_netlink(struct in6_addr* addr_target, int* plen_target, int use_mask
+,	char* prov_ifname, char* devname)
+{
+	struct {
+		struct nlmsghdr		nh;
+		struct ifaddrmsg	ifa;
+	} req;
+	struct addr6_scan	sc;
+	char	name[IF_NAMESIZE];
+
+	memset(&sc, 0, sizeof(sc));
+	sc.target = addr_target;
+	sc.plen = *plen_target;
+	sc.use_mask = use_mask;
+	if (prov_ifname != 0 && *prov_ifname != 0) {
+		if ((sc.ifindex = if_nametoindex(prov_ifname)) == 0) {
+			return 0;
+		}
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+	req.nh.nlmsg_type = RTM_GETADDR;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.ifa.ifa_family = AF_INET6;
+	req.ifa.ifa_index = sc.ifindex;
+	if (rtnl_talk(&req.nh, addr6_scan_cb, &sc) < 0) {
+		return -1;
+	}
+	if (sc.found_ifindex == 0
+	||	if_indextoname(sc.found_ifindex, name) == NULL) {
+		return 0;
+	}
+	strncpy(devname, name, IF_NAMESIZE);
+	*plen_target = sc.found_plen;
+	return 1;
+}
+
+/*
+ * Duplicate address detection.  The event socket is subscribed to
+ * RTNLGRP_IPV6_IFADDR before the address is added, so no change of its
+ * flags can be missed: the kernel announces it TENTATIVE, and then
+ * again either without that flag or with DADFAILED.
+ */
+static int
+dad_open(void)
+{
+	struct sockaddr_nl	nladdr;
+	int	fd, group = RTNLGRP_IPV6_IFADDR;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		return -1;
+	}
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (bind(fd, (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0
+	||	setsockopt(fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP
+		,	&group, sizeof(group)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* what dad_wait() watches, and what it last saw */
+struct dad_state {
+	struct in6_addr	*addr;
+	int		ifindex;
+	int		seen;		/* 1: present, -1: deleted */
+	unsigned	flags;		/* IFA_F_* */
+};
+
+static int
+dad_cb(struct nlmsghdr *nh, void *arg)
+{
+	struct dad_state	*st = arg;
+	struct ifaddrmsg	*ifa = NLMSG_DATA(nh);
+	struct rtattr		*rta;
+	struct in6_addr		*addr = NULL;
+	unsigned		flags;
+	int	attrlen = IFA_PAYLOAD(nh);
+
+	if ((nh->nlmsg_type != RTM_NEWADDR && nh->nlmsg_type != RTM_DELADDR)
+	||	ifa->ifa_family != AF_INET6
+	||	(int)ifa->ifa_index != st->ifindex) {
+		return 0;
+	}
+	flags = ifa->ifa_flags;
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == IFA_LOCAL
+		||	(rta->rta_type == IFA_ADDRESS && addr == NULL)) {
+			addr = RTA_DATA(rta);
+		} else if (rta->rta_type == IFA_FLAGS) {
+			flags = *(uint32_t *)RTA_DATA(rta);
+		}
+	}
+	if (addr == NULL || !IN6_ARE_ADDR_EQUAL(addr, st->addr)) {
+		return 0;
+	}
+	st->seen = nh->nlmsg_type == RTM_NEWADDR ? 1 : -1;
+	st->flags = flags;
+	return 1;
+}
+
+/*
+ * Wait on fd (from dad_open()) until addr6 on if_name has passed DAD.
+ * Returns 0 when it is usable, -1 if DAD failed, the address went away
+ * or timeout_ms passed.
+ */
+static int
+dad_wait(int fd, struct in6_addr* addr6, char* if_name, int timeout_ms)
+{
+	static char		buf[32768];
+	struct dad_state	st;
+	struct timespec		now, end;
+	struct pollfd		pfd;
+	struct nlmsghdr		*nh;
+	int	len, left;
+
+	memset(&st, 0, sizeof(st));
+	st.addr = addr6;
+	st.ifindex = if_nametoindex(if_name);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += timeout_ms / 1000;
+	end.tv_nsec += (timeout_ms % 1000) * 1000000L;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	for (;;) {
+		if (st.seen < 0) {
+			cl_log(LOG_ERR, "address removed from %s during DAD"
+			,	if_name);
+			return -1;
+		}
+		if (st.seen > 0 && (st.flags & IFA_F_DADFAILED)) {
+			cl_log(LOG_ERR, "duplicate address detected on %s"
+			,	if_name);
+			return -1;
+		}
+		if (st.seen > 0 && !(st.flags & IFA_F_TENTATIVE)) {
+			return 0;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		left = (end.tv_sec - now.tv_sec) * 1000
+		+	(end.tv_nsec - now.tv_nsec) / 1000000L;
+		if (left <= 0 || poll(&pfd, 1, left) == 0) {
+			cl_log(LOG_ERR, "DAD on %s did not complete in %d ms"
+			,	if_name, timeout_ms);
+			return -1;
+		}
+		len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == ENOBUFS) {
+				/* events were lost: ask for the state instead */
+				struct {
+					struct nlmsghdr		nh;
+					struct ifaddrmsg	ifa;
+				} req;
+
+				memset(&req, 0, sizeof(req));
+				req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifa));
+				req.nh.nlmsg_type = RTM_GETADDR;
+				req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+				req.ifa.ifa_family = AF_INET6;
+				req.ifa.ifa_index = st.ifindex;
+				st.seen = -1;
+				if (rtnl_talk(&req.nh, dad_cb, &st) < 0) {
+					return -1;
+				}
+			} else if (errno != EINTR && errno != EAGAIN) {
+				return -1;
+			}
+			continue;
+		}
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned)len)
+		;	nh = NLMSG_NEXT(nh, len)) {
+			dad_cb(nh, &st);
+		}
+	}
+}
+#endif /* HAVE_LINUX_RTNETLINK_H */
+
 /* find the network interface associated with an address */
 char*
 scan_if(struct in6_addr* addr_target, int* plen_target, int use_mask, char* prov_ifname)
@@ -425,6 +856,43 @@ scan_if(struct in6_addr* addr_target, int* plen_target, int use_mask, char* prov
 	struct in6_addr mask;
 	unsigned int plen, scope, dad_status, if_idx;
 	unsigned int addr6p[4];
+	struct rtcache_req q;
+	struct rtcache_resp resp;
+
+	/* rtcached, if it runs, has the table at hand already; it applies
+	 * the same rules as the loop below (see rtcache.h)
+	 */
+	memset(&q, 0, sizeof(q));
+	q.version = RTCACHE_VERSION;
+	q.type = use_mask ? RTCACHE_ONLINK : RTCACHE_ADDR;
+	q.family = AF_INET6;
+	q.plen = *plen_target;
+	memcpy(q.addr, addr_target, sizeof(q.addr));
+	if (prov_ifname != 0 && *prov_ifname != 0) {
+		q.ifindex = if_nametoindex(prov_ifname);
+	}
+	if ((q.ifindex || prov_ifname == 0 || *prov_ifname == 0)
+	&&	(use_mask || q.ifindex || !IN6_IS_ADDR_LINKLOCAL(addr_target))
+	&&	rtcache_query(&q, &resp) == 0
+	&&	(resp.status == 0 || resp.status == -ENOENT)) {
+		if (resp.status < 0) {
+			return NULL;
+		}
+		strncpy(devname, resp.match[0].ifname, sizeof(devname) - 1);
+		*plen_target = resp.match[0].plen;
+		return devname;
+	}
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+	switch (scan_if_netlink(addr_target, plen_target, use_mask
+	,	prov_ifname, devname)) {
+	case 1:
+		return devname;
+	case 0:
+		return NULL;
+	}
+	/* otherwise read the table from /proc */
+#endif
 
 	/* open /proc/net/if_inet6 file */
 	if ((f = fopen(IF_INET6, "r")) == NULL) {
@@ -536,39 +1004,30 @@ get_if(struct in6_addr* addr_target, int* plen_target, char* prov_ifname)
 int
 assign_addr6(struct in6_addr* addr6, int prefix_len, char* if_name)
 {
-	struct in6_ifreq ifr6;
-
-	/* Get socket first */
-	int		fd;
-	struct ifreq	ifr;
-
-	fd = socket(AF_INET6, SOCK_DGRAM, 0);
-	if (fd < 0) {
-		return 1;
-	}
-
-	/* Query the index of the if */
-	strcpy(ifr.ifr_name, if_name);
-	if (ioctl(fd, SIOGIFINDEX, &ifr) < 0) {
-		return -1;
-	}
-
-	/* Assign the address to the if */
-	ifr6.ifr6_addr = *addr6;
-	ifr6.ifr6_ifindex = ifr.ifr_ifindex;
-	ifr6.ifr6_prefixlen = prefix_len;
-	if (ioctl(fd, SIOCSIFADDR, &ifr6) < 0) {
-		return -1;
-	}
-	close (fd);
-	return 0;
+#ifdef HAVE_LINUX_RTNETLINK_H
+	return rtnl_addr6(RTM_NEWADDR, addr6, prefix_len, if_name);
+#else
+	return ioctl_addr6(SIOCSIFADDR, addr6, prefix_len, if_name);
+#endif
 }
 int
 unassign_addr6(struct in6_addr* addr6, int prefix_len, char* if_name)
 {
-	int			fd;
-	struct ifreq		ifr;
-	struct in6_ifreq	ifr6;
+#ifdef HAVE_LINUX_RTNETLINK_H
+	return rtnl_addr6(RTM_DELADDR, addr6, prefix_len, if_name);
+#else
+	return ioctl_addr6(SIOCDIFADDR, addr6, prefix_len, if_name);
+#endif
+}
+
+#ifndef HAVE_LINUX_RTNETLINK_H
+/* SIOCSIFADDR or SIOCDIFADDR addr6/prefix_len on if_name */
+static int
+ioctl_addr6(int cmd, struct in6_addr* addr6, int prefix_len, char* if_name)
+{
+	struct in6_ifreq ifr6;
+	struct ifreq	ifr;
+	int		fd, rc = 0;
 
 	/* Get socket first */
 	fd = socket(AF_INET6, SOCK_DGRAM, 0);
@@ -577,79 +1036,135 @@ unassign_addr6(struct in6_addr* addr6, int prefix_len, char* if_name)
 	}
 
 	/* Query the index of the if */
-	strcpy(ifr.ifr_name, if_name);
+	strncpy(ifr.ifr_name, if_name, sizeof(ifr.ifr_name) - 1);
+	ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
 	if (ioctl(fd, SIOGIFINDEX, &ifr) < 0) {
-		return -1;
+		rc = -1;
+		goto out;
 	}
 
-	/* Unassign the address to the if */
+	/* Assign the address to, or unassign it from, the if */
 	ifr6.ifr6_addr = *addr6;
 	ifr6.ifr6_ifindex = ifr.ifr_ifindex;
 	ifr6.ifr6_prefixlen = prefix_len;
-	if (ioctl(fd, SIOCDIFADDR, &ifr6) < 0) {
-		return -1;
+	if (ioctl(fd, cmd, &ifr6) < 0) {
+		rc = -1;
 	}
-	
+out:
 	close (fd);
-	return 0;
+	return rc;
 }
+#endif
 
 #define	MINPACKSIZE	64
+#define	PROBE_COUNT	3	/* echo requests per check */
+#define	PROBE_TIMEOUT	1000	/* ms for a check, all probes included */
+
+static long
+ms_since(const struct timespec *t)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - t->tv_sec) * 1000
+	+	(now.tv_nsec - t->tv_nsec) / 1000000L;
+}
+
+/*
+ * Ping addr6: up to PROBE_COUNT echo requests, spread over the first
+ * half of PROBE_TIMEOUT so that one lost packet does not decide it,
+ * each with our id and its own sequence number.  Only echo replies get
+ * through the filter, and only a reply from addr6 with our id and the
+ * sequence number of a request we sent counts.  Returns 0 as soon as
+ * one is answered (its round trip time is logged), -1 if none is by
+ * the deadline.
+ */
 int
 is_addr6_available(struct in6_addr* addr6)
 {
-	struct sockaddr_in6		addr;
-	struct icmp6_hdr		icmph;
-	u_char				outpack[MINPACKSIZE];
-	int				icmp_sock;
-	int				ret;
-	struct iovec			iov;
-	u_char				packet[MINPACKSIZE];
-	struct msghdr			msg;
-
-	if ((icmp_sock = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6)) == -1) {
+	struct sockaddr_in6	addr, from;
+	struct icmp6_filter	filter;
+	struct icmp6_hdr	*req, *reply;
+	struct timespec		start, sent[PROBE_COUNT];
+	struct pollfd		pfd;
+	socklen_t		fromlen;
+	u_char			outpack[MINPACKSIZE];
+	u_char			packet[MINPACKSIZE];
+	uint16_t		id = getpid() & 0xffff;
+	int			icmp_sock, nsent = 0, ret = -1;
+	long			elapsed, wait, seq;
+
+	if ((icmp_sock = socket(AF_INET6, SOCK_RAW | SOCK_CLOEXEC
+	,	IPPROTO_ICMPV6)) == -1) {
 		return -1;
 	}
-
-	memset(&icmph, 0, sizeof(icmph));
-	icmph.icmp6_type = ICMP6_ECHO_REQUEST;
-	icmph.icmp6_code = 0;
-	icmph.icmp6_cksum = 0;
-	icmph.icmp6_seq = htons(0);
-	icmph.icmp6_id = 0;
-
-	memset(&outpack, 0, sizeof(outpack));
-	memcpy(&outpack, &icmph, sizeof(icmph));
+	ICMP6_FILTER_SETBLOCKALL(&filter);
+	ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+	setsockopt(icmp_sock, IPPROTO_ICMPV6, ICMP6_FILTER
+	,	&filter, sizeof(filter));
 
 	memset(&addr, 0, sizeof(struct sockaddr_in6));
 	addr.sin6_family = AF_INET6;
-	addr.sin6_port = htons(IPPROTO_ICMPV6);
 	memcpy(&addr.sin6_addr,addr6,sizeof(struct in6_addr));
 
 	/* Only the first 8 bytes of outpack are meaningful... */
-	ret = sendto(icmp_sock, (char *)outpack, sizeof(outpack), 0,
-			   (struct sockaddr *) &addr,
-			   sizeof(struct sockaddr_in6));
-	if (0 >= ret) {
-		return -1;
-	}
-
-	iov.iov_base = (char *)packet;
-	iov.iov_len = sizeof(packet); 
-
-	msg.msg_name = &addr;
-	msg.msg_namelen = sizeof(addr);
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-	msg.msg_control = NULL;
-	msg.msg_controllen = 0;
+	memset(&outpack, 0, sizeof(outpack));
+	req = (struct icmp6_hdr *)outpack;
+	req->icmp6_type = ICMP6_ECHO_REQUEST;
+	req->icmp6_code = 0;
+	req->icmp6_cksum = 0;		/* the kernel fills it in */
+	req->icmp6_id = htons(id);
+
+	pfd.fd = icmp_sock;
+	pfd.events = POLLIN;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		elapsed = ms_since(&start);
+		if (elapsed >= PROBE_TIMEOUT) {
+			break;
+		}
+		/* next probe due? */
+		if (nsent < PROBE_COUNT
+		&&	elapsed >= nsent * (PROBE_TIMEOUT / 2 / PROBE_COUNT)) {
+			req->icmp6_seq = htons(nsent);
+			clock_gettime(CLOCK_MONOTONIC, &sent[nsent]);
+			if (sendto(icmp_sock, (char *)outpack, sizeof(outpack), 0
+			,	(struct sockaddr *) &addr
+			,	sizeof(struct sockaddr_in6)) <= 0) {
+				break;
+			}
+			nsent++;
+			continue;
+		}
+		wait = PROBE_TIMEOUT - elapsed;
+		if (nsent < PROBE_COUNT) {
+			wait = nsent * (PROBE_TIMEOUT / 2 / PROBE_COUNT) - elapsed;
+		}
+		if (poll(&pfd, 1, wait) <= 0) {
+			continue;
+		}
 
-	ret = recvmsg(icmp_sock, &msg, MSG_DONTWAIT);
-	if (0 >= ret) {
-		return -1;
+		fromlen = sizeof(from);
+		if (recvfrom(icmp_sock, packet, sizeof(packet), MSG_DONTWAIT
+		,	(struct sockaddr *)&from, &fromlen)
+		<	(ssize_t)sizeof(struct icmp6_hdr)) {
+			continue;
+		}
+		reply = (struct icmp6_hdr *)packet;
+		seq = ntohs(reply->icmp6_seq);
+		if (reply->icmp6_type != ICMP6_ECHO_REPLY
+		||	ntohs(reply->icmp6_id) != id || seq >= nsent
+		||	!IN6_ARE_ADDR_EQUAL(&from.sin6_addr, addr6)) {
+			continue;
+		}
+		cl_log(LOG_DEBUG, "echo reply seq %ld after %ld ms"
+		,	seq, ms_since(&sent[seq]));
+		ret = 0;
+		break;
 	}
-	
-	return 0;
+
+	close(icmp_sock);
+	return ret;
 }
 
 static void usage(const char* self)
@@ -33,34 +33,59 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <errno.h>
+#include <time.h>
 
-/* Send an unsolicited advertisement packet
+/* Fill payload (UA_PAYLOAD_SIZE bytes) with an unsolicited neighbor
+ * advertisement for target, carrying hwaddr as its link-layer address
+ */
+void
+ua_build(u_int8_t* payload, struct in6_addr* target, const void* hwaddr)
+{
+	struct nd_neighbor_advert *na;
+	struct nd_opt_hdr *opt;
+
+	memset(payload, 0, UA_PAYLOAD_SIZE);
+
+	/* Ugly typecast from ia64 hell! */
+	na = (struct nd_neighbor_advert *)((void *)payload);
+	na->nd_na_type = ND_NEIGHBOR_ADVERT;
+	na->nd_na_code = 0;
+	na->nd_na_cksum = 0; /* calculated by kernel */
+	na->nd_na_flags_reserved = ND_NA_FLAG_OVERRIDE;
+	na->nd_na_target = *target;
+
+	/* options field; set the target link-layer address */
+	opt = (struct nd_opt_hdr *)(payload + sizeof(struct nd_neighbor_advert));
+	opt->nd_opt_type = ND_OPT_TARGET_LINKADDR;
+	opt->nd_opt_len = 1; /* The length of the option in units of 8 octets */
+	memcpy(payload + sizeof(struct nd_neighbor_advert)
+			+ sizeof(struct nd_opt_hdr),
+	       hwaddr, HWADDR_LEN);
+}
+
+/* Prepare to send unsolicited advertisement packets: the socket and
+ * the packet are set up once, however many are sent.
  * Please refer to rfc4861 / rfc3542
  */
 int
-send_ua(struct in6_addr* src_ip, char* if_name)
+ua_open(struct ua_packet* ua, struct in6_addr* src_ip, char* if_name)
 {
-	int status = -1;
-	int fd;
-
 	int ifindex;
 	int hop;
 	struct ifreq ifr;
-	u_int8_t *payload = NULL;
-	int    payload_size;
-	struct nd_neighbor_advert *na;
-	struct nd_opt_hdr *opt;
 	struct sockaddr_in6 src_sin6;
-	struct sockaddr_in6 dst_sin6;
 
-	if ((fd = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6)) == -1) {
+	memset(ua, 0, sizeof(*ua));
+	strncpy(ua->if_name, if_name, sizeof(ua->if_name) - 1);
+
+	if ((ua->fd = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6)) == -1) {
 		printf("ERROR: socket(IPPROTO_ICMPV6) failed: %s",
 		       strerror(errno));
-		return status;
+		return -1;
 	}
 	/* set the outgoing interface */
 	ifindex = if_nametoindex(if_name);
-	if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+	if (setsockopt(ua->fd, IPPROTO_IPV6, IPV6_MULTICAST_IF,
 		       &ifindex, sizeof(ifindex)) < 0) {
 		printf("ERROR: setsockopt(IPV6_MULTICAST_IF) failed: %s",
 		       strerror(errno));
@@ -68,7 +93,7 @@ send_ua(struct in6_addr* src_ip, char* if_name)
 	}
 	/* set the hop limit */
 	hop = 255; /* 255 is required. see rfc4861 7.1.2 */
-	if (setsockopt(fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+	if (setsockopt(ua->fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
 		       &hop, sizeof(hop)) < 0) {
 		printf("ERROR: setsockopt(IPV6_MULTICAST_HOPS) failed: %s",
 		       strerror(errno));
@@ -85,7 +110,7 @@ send_ua(struct in6_addr* src_ip, char* if_name)
 		src_sin6.sin6_scope_id = ifindex;
 	}
 
-	if (bind(fd, (struct sockaddr *)&src_sin6, sizeof(src_sin6)) < 0) {
+	if (bind(ua->fd, (struct sockaddr *)&src_sin6, sizeof(src_sin6)) < 0) {
 		printf("ERROR: bind() failed: %s", strerror(errno));
 		goto err;
 	}
@@ -94,54 +119,98 @@ send_ua(struct in6_addr* src_ip, char* if_name)
 	/* get the hardware address */
 	memset(&ifr, 0, sizeof(ifr));
 	strncpy(ifr.ifr_name, if_name, sizeof(ifr.ifr_name) - 1);
-	if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+	if (ioctl(ua->fd, SIOCGIFHWADDR, &ifr) < 0) {
 		printf("ERROR: ioctl(SIOCGIFHWADDR) failed: %s", strerror(errno));
 		goto err;
 	}
 
 	/* build a neighbor advertisement message */
-	payload_size = sizeof(struct nd_neighbor_advert)
-			 + sizeof(struct nd_opt_hdr) + HWADDR_LEN;
-	payload = memalign(sysconf(_SC_PAGESIZE), payload_size);
-	if (!payload) {
-		printf("ERROR: malloc for payload failed");
-		goto err;
-	}
-	memset(payload, 0, payload_size);
-
-	/* Ugly typecast from ia64 hell! */
-	na = (struct nd_neighbor_advert *)((void *)payload);
-	na->nd_na_type = ND_NEIGHBOR_ADVERT;
-	na->nd_na_code = 0;
-	na->nd_na_cksum = 0; /* calculated by kernel */
-	na->nd_na_flags_reserved = ND_NA_FLAG_OVERRIDE;
-	na->nd_na_target = *src_ip;
-
-	/* options field; set the target link-layer address */
-	opt = (struct nd_opt_hdr *)(payload + sizeof(struct nd_neighbor_advert));
-	opt->nd_opt_type = ND_OPT_TARGET_LINKADDR;
-	opt->nd_opt_len = 1; /* The length of the option in units of 8 octets */
-	memcpy(payload + sizeof(struct nd_neighbor_advert)
-			+ sizeof(struct nd_opt_hdr),
-	       &ifr.ifr_hwaddr.sa_data, HWADDR_LEN);
+	ua->payload_size = UA_PAYLOAD_SIZE;
+	ua_build(ua->payload, src_ip, ifr.ifr_hwaddr.sa_data);
 
 	/* sending an unsolicited neighbor advertisement to all */
-	memset(&dst_sin6, 0, sizeof(dst_sin6));
-	dst_sin6.sin6_family = AF_INET6;
-	inet_pton(AF_INET6, BCAST_ADDR, &dst_sin6.sin6_addr); /* should not fail */
+	ua->dst.sin6_family = AF_INET6;
+	inet_pton(AF_INET6, BCAST_ADDR, &ua->dst.sin6_addr); /* should not fail */
+	return 0;
+
+err:
+	ua_close(ua);
+	return -1;
+}
 
-	if (sendto(fd, payload, payload_size, 0,
-		   (struct sockaddr *)&dst_sin6, sizeof(dst_sin6))
-	    != payload_size) {
+/* Send the prepared advertisement once */
+int
+ua_send(struct ua_packet* ua)
+{
+	if (sendto(ua->fd, ua->payload, ua->payload_size, 0,
+		   (struct sockaddr *)&ua->dst, sizeof(ua->dst))
+	    != ua->payload_size) {
 		printf("ERROR: sendto(%s) failed: %s",
-		       if_name, strerror(errno));
-		goto err;
+		       ua->if_name, strerror(errno));
+		return -1;
 	}
+	return 0;
+}
 
-	status = 0;
+/* Move the CLOCK_MONOTONIC time next on by delay msec and sleep until
+ * then.  Sends timed this way keep to their schedule: the time a send
+ * takes does not add up.
+ */
+void
+ua_wait(struct timespec* next, int delay)
+{
+	next->tv_sec += delay / 1000;
+	next->tv_nsec += (delay % 1000) * 1000000L;
+	if (next->tv_nsec >= 1000000000L) {
+		next->tv_sec++;
+		next->tv_nsec -= 1000000000L;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+			       next, NULL) == EINTR)
+		;
+}
 
-err:
-	close(fd);
-	free(payload);
+/* Send it count times, interval msec apart, the first one at once and
+ * nothing waited for after the last.
+ */
+int
+ua_send_repeat(struct ua_packet* ua, int count, int interval)
+{
+	struct timespec next;
+	int i, status = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (i = 0; i < count; i++) {
+		if (i > 0) {
+			ua_wait(&next, interval);
+		}
+		if (ua_send(ua) < 0) {
+			status = -1;
+		}
+	}
+	return status;
+}
+
+void
+ua_close(struct ua_packet* ua)
+{
+	if (ua->fd >= 0) {
+		close(ua->fd);
+	}
+	ua->fd = -1;
+}
+
+/* Send an unsolicited advertisement packet */
+int
+send_ua(struct in6_addr* src_ip, char* if_name)
+{
+	struct ua_packet ua;
+	int status;
+
+	if (ua_open(&ua, src_ip, if_name) < 0) {
+		return -1;
+	}
+	status = ua_send(&ua);
+	ua_close(&ua);
 	return status;
 }
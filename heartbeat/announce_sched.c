@@ -0,0 +1,64 @@
+/*
+ * announce_sched.c: announcement schedules (see announce_sched.h),
+ * shared by send_arp and send_ua
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <announce_sched.h>
+
+int
+announce_sched_parse(struct announce_sched *s, const char *spec, int jitter)
+{
+	const char	*p = spec;
+	char		*end;
+	long		v;
+
+	if (jitter < 0 || jitter > 100) {
+		return -1;
+	}
+	s->n = 0;
+	s->jitter = jitter;
+	do {
+		v = strtol(p, &end, 10);
+		if (end == p || v < 0 || v > 3600000
+		||	(*end != ',' && *end != '\0')
+		||	s->n == ANNOUNCE_SCHED_MAX) {
+			return -1;
+		}
+		s->gap[s->n++] = v;
+		p = end + 1;
+	} while (*end == ',');
+
+	if (jitter) {
+		srand(getpid() ^ time(NULL));
+	}
+	return 0;
+}
+
+int
+announce_sched_delay(const struct announce_sched *s, int i)
+{
+	int	gap = s->gap[i < s->n ? i : s->n - 1];
+
+	if (s->jitter && gap > 0) {
+		gap += (int)((double)gap * s->jitter / 100
+		*	(2.0 * rand() / RAND_MAX - 1.0));
+	}
+	return gap > 0 ? gap : 0;
+}
@@ -200,6 +200,7 @@ findif()
   local nic="$OCF_RESKEY_nic"
   local netmask="$OCF_RESKEY_cidr_netmask"
   local brdcast="$OCF_RESKEY_broadcast"
+  local nicinfo
 
   echo $match | grep -qs ":"
   if [ $? = 0 ] ; then
@@ -210,6 +211,20 @@ findif()
   fi
   findif_check_params $family || return $?
 
+  # the compiled findif asks the kernel over rtnetlink, with no ip
+  # commands to run and parse; if it cannot tell, look below as before
+  if [ $family = "inet6" ] && [ -x "$HA_BIN/findif" ] ; then
+    nicinfo=`OCF_RESKEY_ip="$match" OCF_RESKEY_cidr_netmask="$netmask" \
+      OCF_RESKEY_nic="$nic" OCF_RESKEY_broadcast= "$HA_BIN/findif" -C 2>/dev/null`
+    if [ $? = 0 ] ; then
+      set -- $nicinfo
+      if [ "$2" = netmask ] ; then
+        echo "$1 netmask $3 broadcast $brdcast"
+        return $OCF_SUCCESS
+      fi
+    fi
+  fi
+
   if [ -n "$netmask" ] ; then
       match=$match/$netmask
   fi
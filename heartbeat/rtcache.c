@@ -0,0 +1,83 @@
+/*
+ * rtcache.c: client side of the rtcached protocol (see rtcache.h),
+ * shared by findif, IPv6addr and rtcached -q
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <config.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <rtcache.h>
+
+int
+rtcache_query(const struct rtcache_req *req, struct rtcache_resp *resp)
+{
+	static int		fd = -1, failed;
+	static struct stat	netns;
+	struct sockaddr_un	sun;
+	struct pollfd		pfd;
+	ssize_t			len;
+
+	if (failed) {
+		return -1;
+	}
+	if (fd < 0) {
+		if (stat(RTCACHE_NETNS, &netns) < 0) {
+			goto fail;
+		}
+		fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (fd < 0) {
+			goto fail;
+		}
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strncpy(sun.sun_path, RTCACHE_SOCKET, sizeof(sun.sun_path) - 1);
+		if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+			goto fail;
+		}
+	}
+
+	if (send(fd, req, sizeof(*req), MSG_NOSIGNAL) != sizeof(*req)) {
+		goto fail;
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, RTCACHE_TIMEOUT) != 1) {
+		goto fail;
+	}
+	len = recv(fd, resp, sizeof(*resp), 0);
+	if (len != sizeof(*resp) || resp->count > RTCACHE_MAX_MATCH) {
+		goto fail;
+	}
+	if (resp->netns_dev != (uint64_t)netns.st_dev
+	||	resp->netns_ino != (uint64_t)netns.st_ino) {
+		goto fail;
+	}
+	return 0;
+
+fail:
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	failed = 1;
+	return -1;
+}
@@ -0,0 +1,639 @@
+/*
+ * send_announce: announce many IPv4 and IPv6 addresses from one process
+ *
+ * Sends gratuitous ARPs (unsolicited ARP requests, as "send_arp -U" does)
+ * for IPv4 addresses and unsolicited neighbor advertisements (as send_ua
+ * does) for IPv6 addresses, for any number of (address, interface)
+ * pairs.  One packet socket and one ICMPv6 socket are shared by all of
+ * them, every packet is built once, and each round sends one packet for
+ * every address, so taking over a few hundred addresses costs one
+ * process and a few hundred sendto()s per round.
+ *
+ * With -D it checks IPv4 addresses before they are taken over instead:
+ * ARP probes (RFC 5227: sender address 0.0.0.0) go out for all of them
+ * on the one packet socket, and every ARP naming one of them, from
+ * another host, until a single deadline is a conflict.  A BPF filter
+ * on the socket passes only those ARPs, so a group of addresses is
+ * checked in one short wait rather than one wait each.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <IPv6addr.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h> /* for inet_pton */
+#include <net/if.h> /* for if_nametoindex */
+#include <net/if_arp.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#define ARP_PAYLOAD_SIZE	(sizeof(struct arphdr) + 2 * (HWADDR_LEN + 4))
+
+/* -D: exit status when an address is in use, apart from the OCF ones */
+#define PROBE_CONFLICT		10
+
+struct ann_if {
+	char		name[IF_NAMESIZE];
+	int		ifindex;
+	unsigned short	hatype;
+	unsigned char	hwaddr[HWADDR_LEN];
+};
+
+struct announce {
+	int		family;
+	struct in_addr	addr4;		/* AF_INET */
+	struct in6_addr	addr6;		/* AF_INET6 */
+	int		conflict;	/* -D: another host has it */
+	int		ifi;		/* index into ifs */
+	u_int8_t	payload[ARP_PAYLOAD_SIZE > UA_PAYLOAD_SIZE
+				? ARP_PAYLOAD_SIZE : UA_PAYLOAD_SIZE];
+	int		payload_size;
+};
+
+static struct ann_if	*ifs;
+static int		nifs;
+static struct announce	*anns;
+static int		nanns;
+
+static int		arp_fd = -1;
+static int		nd_fd = -1;
+
+static int		probe;		/* -D */
+
+static void usage_send_announce(const char* self);
+static void byebye(int nsig);
+
+/* the interface called name, looked up the first time it is named */
+static int
+get_if(const char* name)
+{
+	struct ann_if	*p;
+	struct ifreq	ifr;
+	int		i, fd;
+
+	for (i = 0; i < nifs; i++) {
+		if (strcmp(ifs[i].name, name) == 0) {
+			return i;
+		}
+	}
+	if (strlen(name) >= IF_NAMESIZE) {
+		printf("ERROR: interface name too long: %s\n", name);
+		return -1;
+	}
+
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		printf("ERROR: socket() failed: %s\n", strerror(errno));
+		return -1;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, name, sizeof(ifr.ifr_name) - 1);
+	if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
+		printf("ERROR: ioctl(SIOCGIFHWADDR) on %s failed: %s\n",
+		       name, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	close(fd);
+
+	if ((p = realloc(ifs, (nifs + 1) * sizeof(*ifs))) == NULL) {
+		printf("ERROR: out of memory\n");
+		return -1;
+	}
+	ifs = p;
+	p = &ifs[nifs];
+	memset(p, 0, sizeof(*p));
+	strncpy(p->name, name, sizeof(p->name) - 1);
+	p->ifindex = if_nametoindex(name);
+	p->hatype = ifr.ifr_hwaddr.sa_family;
+	memcpy(p->hwaddr, ifr.ifr_hwaddr.sa_data, HWADDR_LEN);
+	return nifs++;
+}
+
+/* an unsolicited ARP request: sender and target are both the address */
+static int
+build_garp(u_int8_t* payload, struct in_addr* addr, struct ann_if* ifp)
+{
+	struct arphdr	*ah = (struct arphdr *)payload;
+	u_int8_t	*p = (u_int8_t *)(ah + 1);
+
+	ah->ar_hrd = htons(ARPHRD_ETHER);
+	ah->ar_pro = htons(ETH_P_IP);
+	ah->ar_hln = HWADDR_LEN;
+	ah->ar_pln = 4;
+	ah->ar_op  = htons(ARPOP_REQUEST);
+
+	memcpy(p, ifp->hwaddr, HWADDR_LEN);
+	p += HWADDR_LEN;
+	memcpy(p, addr, 4);
+	p += 4;
+	memset(p, 0xff, HWADDR_LEN);
+	p += HWADDR_LEN;
+	memcpy(p, addr, 4);
+	p += 4;
+	return p - payload;
+}
+
+/* an ARP probe: sender address 0.0.0.0, target the address to check */
+static int
+build_probe(u_int8_t* payload, struct in_addr* addr, struct ann_if* ifp)
+{
+	struct arphdr	*ah = (struct arphdr *)payload;
+	u_int8_t	*p = (u_int8_t *)(ah + 1);
+
+	ah->ar_hrd = htons(ARPHRD_ETHER);
+	ah->ar_pro = htons(ETH_P_IP);
+	ah->ar_hln = HWADDR_LEN;
+	ah->ar_pln = 4;
+	ah->ar_op  = htons(ARPOP_REQUEST);
+
+	memcpy(p, ifp->hwaddr, HWADDR_LEN);
+	p += HWADDR_LEN;
+	memset(p, 0, 4);
+	p += 4;
+	memset(p, 0, HWADDR_LEN);
+	p += HWADDR_LEN;
+	memcpy(p, addr, 4);
+	p += 4;
+	return p - payload;
+}
+
+/* add "address interface"; the address may carry a (legacy) /prefix */
+static int
+add_announce(char* address, char* if_name)
+{
+	struct announce	*a;
+	struct in_addr	addr4;
+	char		*cp;
+	int		ifi;
+
+	if ((cp = strchr(address, '/'))) {
+		*cp = 0;
+	}
+	if ((ifi = get_if(if_name)) < 0) {
+		return -1;
+	}
+	if ((a = realloc(anns, (nanns + 1) * sizeof(*anns))) == NULL) {
+		printf("ERROR: out of memory\n");
+		return -1;
+	}
+	anns = a;
+	a = &anns[nanns];
+	memset(a, 0, sizeof(*a));
+	a->ifi = ifi;
+
+	if (inet_pton(AF_INET, address, &addr4) > 0) {
+		if (ifs[ifi].hatype != ARPHRD_ETHER) {
+			printf("ERROR: %s is not an Ethernet interface,"
+			       " use send_arp for %s\n", if_name, address);
+			return -1;
+		}
+		a->family = AF_INET;
+		a->addr4 = addr4;
+		if (probe) {
+			a->payload_size = build_probe(a->payload, &addr4, &ifs[ifi]);
+		} else {
+			a->payload_size = build_garp(a->payload, &addr4, &ifs[ifi]);
+		}
+	} else if (inet_pton(AF_INET6, address, &a->addr6) > 0) {
+		if (probe) {
+			printf("ERROR: -D is for IPv4, the kernel does DAD"
+			       " for IPv6 address %s\n", address);
+			return -1;
+		}
+		a->family = AF_INET6;
+		a->payload_size = UA_PAYLOAD_SIZE;
+		ua_build(a->payload, &a->addr6, ifs[ifi].hwaddr);
+	} else {
+		printf("ERROR: Invalid IP address [%s]\n", address);
+		return -1;
+	}
+	nanns++;
+	return 0;
+}
+
+/*
+ * -D: have the kernel queue only ARPs from elsewhere that name one of
+ * our addresses, as sender or as target.  Each address costs a compare
+ * and a return for either field, four instructions, and every jump is
+ * short; with too many addresses for one filter everything is left to
+ * check_probe_reply().
+ */
+static void
+bpf_insn(struct sock_filter* f, u_int16_t code, u_int32_t k,
+	 u_int8_t jt, u_int8_t jf)
+{
+	f->code = code;
+	f->jt = jt;
+	f->jf = jf;
+	f->k = k;
+}
+
+static void
+attach_probe_filter(void)
+{
+	struct sock_filter	*f;
+	struct sock_fprog	prog;
+	int			i, n, off;
+
+	if (9 + 4 * nanns > BPF_MAXINSNS) {
+		return;
+	}
+	if ((f = calloc(9 + 4 * nanns, sizeof(*f))) == NULL) {
+		return;
+	}
+	i = 0;
+	/* not our own probes going out */
+	bpf_insn(&f[i++], BPF_LD | BPF_B | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE, 0, 0);
+	bpf_insn(&f[i++], BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 0, 1);
+	bpf_insn(&f[i++], BPF_RET | BPF_K, 0, 0, 0);
+	/* the socket is SOCK_DGRAM: offsets are into the ARP header */
+	bpf_insn(&f[i++], BPF_LD | BPF_H | BPF_ABS, 2, 0, 0);
+	bpf_insn(&f[i++], BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 1, 0);
+	bpf_insn(&f[i++], BPF_RET | BPF_K, 0, 0, 0);
+	/* sender address, then target address */
+	for (off = 14; off <= 24; off += 10) {
+		bpf_insn(&f[i++], BPF_LD | BPF_W | BPF_ABS, off, 0, 0);
+		for (n = 0; n < nanns; n++) {
+			bpf_insn(&f[i++], BPF_JMP | BPF_JEQ | BPF_K,
+				 ntohl(anns[n].addr4.s_addr), 0, 1);
+			bpf_insn(&f[i++], BPF_RET | BPF_K, 0xffff, 0, 0);
+		}
+	}
+	bpf_insn(&f[i++], BPF_RET | BPF_K, 0, 0, 0);
+
+	prog.len = i;
+	prog.filter = f;
+	if (setsockopt(arp_fd, SOL_SOCKET, SO_ATTACH_FILTER,
+		       &prog, sizeof(prog)) < 0) {
+		printf("WARNING: setsockopt(SO_ATTACH_FILTER) failed: %s\n",
+		       strerror(errno));
+	}
+	free(f);
+}
+
+/* the two shared sockets, only those that are needed */
+static int
+open_sockets(void)
+{
+	struct icmp6_filter filter;
+	struct sockaddr_ll sll;
+	int	i, hop = 255; /* 255 is required. see rfc4861 7.1.2 */
+
+	for (i = 0; i < nanns; i++) {
+		if (anns[i].family == AF_INET && arp_fd < 0) {
+			arp_fd = socket(PF_PACKET, SOCK_DGRAM, 0);
+			if (arp_fd < 0) {
+				printf("ERROR: socket(PF_PACKET) failed: %s\n",
+				       strerror(errno));
+				return -1;
+			}
+			if (probe) {
+				/* no protocol yet: nothing is queued
+				 * until the filter is in place */
+				attach_probe_filter();
+				memset(&sll, 0, sizeof(sll));
+				sll.sll_family = AF_PACKET;
+				sll.sll_protocol = htons(ETH_P_ARP);
+				if (bind(arp_fd, (struct sockaddr *)&sll,
+					 sizeof(sll)) < 0) {
+					printf("ERROR: bind(PF_PACKET) failed: %s\n",
+					       strerror(errno));
+					return -1;
+				}
+			}
+		}
+		if (anns[i].family == AF_INET6 && nd_fd < 0) {
+			nd_fd = socket(AF_INET6, SOCK_RAW, IPPROTO_ICMPV6);
+			if (nd_fd < 0) {
+				printf("ERROR: socket(IPPROTO_ICMPV6) failed: %s\n",
+				       strerror(errno));
+				return -1;
+			}
+			if (setsockopt(nd_fd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+				       &hop, sizeof(hop)) < 0) {
+				printf("ERROR: setsockopt(IPV6_MULTICAST_HOPS) failed: %s\n",
+				       strerror(errno));
+				return -1;
+			}
+			/* we only send; don't queue what others send */
+			ICMP6_FILTER_SETBLOCKALL(&filter);
+			setsockopt(nd_fd, IPPROTO_ICMPV6, ICMP6_FILTER,
+				   &filter, sizeof(filter));
+		}
+	}
+	return 0;
+}
+
+static int
+send_announce(struct announce* a)
+{
+	struct ann_if	*ifp = &ifs[a->ifi];
+	ssize_t		rc;
+
+	if (a->family == AF_INET) {
+		struct sockaddr_ll he;
+
+		memset(&he, 0, sizeof(he));
+		he.sll_family = AF_PACKET;
+		he.sll_protocol = htons(ETH_P_ARP);
+		he.sll_ifindex = ifp->ifindex;
+		he.sll_halen = HWADDR_LEN;
+		memset(he.sll_addr, 0xff, HWADDR_LEN);
+		rc = sendto(arp_fd, a->payload, a->payload_size, 0,
+			    (struct sockaddr *)&he, sizeof(he));
+	} else {
+		/* the source address and interface go with each packet */
+		struct sockaddr_in6	dst;
+		struct in6_pktinfo	*pi;
+		struct cmsghdr		*cmsg;
+		struct msghdr		msg;
+		struct iovec		iov;
+		union {
+			struct cmsghdr	align;
+			char		buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+		} control;
+
+		memset(&dst, 0, sizeof(dst));
+		dst.sin6_family = AF_INET6;
+		inet_pton(AF_INET6, BCAST_ADDR, &dst.sin6_addr); /* should not fail */
+		dst.sin6_scope_id = ifp->ifindex;
+
+		iov.iov_base = a->payload;
+		iov.iov_len = a->payload_size;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_name = &dst;
+		msg.msg_namelen = sizeof(dst);
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		memset(&control, 0, sizeof(control));
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = IPPROTO_IPV6;
+		cmsg->cmsg_type = IPV6_PKTINFO;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
+		pi = (struct in6_pktinfo *)CMSG_DATA(cmsg);
+		pi->ipi6_addr = a->addr6;
+		pi->ipi6_ifindex = ifp->ifindex;
+		rc = sendmsg(nd_fd, &msg, 0);
+	}
+	if (rc != a->payload_size) {
+		printf("ERROR: sending on %s failed: %s\n",
+		       ifp->name, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static long
+now_ms(void)
+{
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/*
+ * -D: an ARP seen on the interface of one of our addresses, from another
+ * host, that either uses the address (sender) or probes for it too
+ * (sender 0.0.0.0, target the address) marks that address in use.
+ */
+static void
+check_probe_reply(u_int8_t* buf, int len, struct sockaddr_ll* from)
+{
+	struct arphdr	*ah = (struct arphdr *)buf;
+	u_int8_t	*sha = (u_int8_t *)(ah + 1);
+	u_int8_t	*spa = sha + HWADDR_LEN;
+	u_int8_t	*tpa = spa + 4 + HWADDR_LEN;
+	struct announce	*a;
+	int		i;
+
+	if (from->sll_pkttype == PACKET_OUTGOING
+	||  len < (int)ARP_PAYLOAD_SIZE
+	||  ah->ar_pro != htons(ETH_P_IP)
+	||  ah->ar_hln != HWADDR_LEN || ah->ar_pln != 4
+	||  (ah->ar_op != htons(ARPOP_REQUEST)
+	     && ah->ar_op != htons(ARPOP_REPLY))) {
+		return;
+	}
+	for (i = 0; i < nanns; i++) {
+		a = &anns[i];
+		if (a->conflict || ifs[a->ifi].ifindex != from->sll_ifindex
+		||  memcmp(sha, ifs[a->ifi].hwaddr, HWADDR_LEN) == 0) {
+			continue;
+		}
+		if (memcmp(spa, &a->addr4, 4) == 0
+		||  (memcmp(spa, "\0\0\0\0", 4) == 0
+		     && memcmp(tpa, &a->addr4, 4) == 0)) {
+			a->conflict = 1;
+			printf("CONFLICT: %s on %s is in use by"
+			       " %02x:%02x:%02x:%02x:%02x:%02x\n",
+			       inet_ntoa(a->addr4), ifs[a->ifi].name,
+			       sha[0], sha[1], sha[2], sha[3], sha[4], sha[5]);
+		}
+	}
+}
+
+/*
+ * -D: send count rounds of probes interval ms apart and watch for
+ * conflicts until wait ms after the first round, or until every
+ * address is known to be in use.  Returns the number in use, or -1 if
+ * none is and a probe could not be sent: the answer is not known then.
+ */
+static int
+run_probe(int count, int interval, int wait)
+{
+	struct sockaddr_ll from;
+	socklen_t	alen;
+	struct pollfd	pfd;
+	u_int8_t	buf[256];
+	long		start, now, next, timeout;
+	int		i, len, round = 0, conflicts = 0, failed = 0;
+
+	start = now_ms();
+	next = start;
+	pfd.fd = arp_fd;
+	pfd.events = POLLIN;
+	while ((now = now_ms()) < start + wait && conflicts < nanns) {
+		if (round < count && now >= next) {
+			for (i = 0; i < nanns; i++) {
+				if (!anns[i].conflict
+				&&  send_announce(&anns[i]) < 0) {
+					failed++;
+				}
+			}
+			round++;
+			next += interval;
+		}
+		timeout = start + wait - now;
+		if (round < count && next - now < timeout) {
+			timeout = next - now;
+		}
+		if (poll(&pfd, 1, timeout) <= 0) {
+			continue;
+		}
+		for (;;) {
+			alen = sizeof(from);
+			len = recvfrom(arp_fd, buf, sizeof(buf), MSG_DONTWAIT,
+				       (struct sockaddr *)&from, &alen);
+			if (len < 0) {
+				break;
+			}
+			check_probe_reply(buf, len, &from);
+		}
+		conflicts = 0;
+		for (i = 0; i < nanns; i++) {
+			conflicts += anns[i].conflict;
+		}
+	}
+	return conflicts == 0 && failed ? -1 : conflicts;
+}
+
+int
+main(int argc, char* argv[])
+{
+	int		count = -1;
+	int		interval = -1;
+	int		wait = 200;		/* -D: default 200 msec */
+	int		ch, i, n, round, failed = 0;
+	char		line[256], address[128], if_name[64];
+	struct timespec	next;
+	struct sigaction act;
+
+	while ((ch = getopt(argc, argv, "h?c:i:Dw:")) != EOF) {
+		switch(ch) {
+		case 'D': /* probe option */
+			probe = 1;
+		    break;
+		case 'w': /* wait option */
+			wait = atoi(optarg);
+		    break;
+		case 'c': /* count option */
+			count = atoi(optarg);
+		    break;
+		case 'i': /* interval option */
+			interval = atoi(optarg);
+		    break;
+		case 'h':
+		case '?':
+		default:
+			usage_send_announce(argv[0]);
+			return OCF_ERR_ARGS;
+		}
+	}
+	/* probes go out quickly and twice, announcements once a second */
+	if (count < 0) {
+		count = probe ? 2 : UA_REPEAT_COUNT;
+	}
+	if (interval < 0) {
+		interval = probe ? 100 : 1000;
+	}
+
+	/* set termination signal */
+	memset(&act, 0, sizeof(struct sigaction));
+	act.sa_handler = byebye;
+	if ((sigemptyset(&act.sa_mask) < 0) || (sigaction(SIGTERM, &act, NULL) < 0)) {
+		printf("ERROR: Could not set handler for signal: %s", strerror(errno));
+		return OCF_ERR_GENERIC;
+	}
+
+	if (optind < argc) {
+		if ((argc - optind) % 2 != 0) {
+			usage_send_announce(argv[0]);
+			return OCF_ERR_ARGS;
+		}
+		for (i = optind; i < argc; i += 2) {
+			if (add_announce(argv[i], argv[i+1]) < 0) {
+				return OCF_ERR_ARGS;
+			}
+		}
+	} else {
+		while (fgets(line, sizeof(line), stdin)) {
+			n = sscanf(line, "%127s %63s", address, if_name);
+			if (n < 1 || address[0] == '#') {
+				continue;
+			}
+			if (n != 2) {
+				printf("ERROR: no interface for %s\n", address);
+				return OCF_ERR_ARGS;
+			}
+			if (add_announce(address, if_name) < 0) {
+				return OCF_ERR_ARGS;
+			}
+		}
+	}
+	if (nanns == 0) {
+		usage_send_announce(argv[0]);
+		return OCF_ERR_ARGS;
+	}
+	if (open_sockets() < 0) {
+		return OCF_ERR_GENERIC;
+	}
+	if (probe) {
+		n = run_probe(count, interval, wait);
+		return n < 0 ? OCF_ERR_GENERIC
+			: n > 0 ? PROBE_CONFLICT : OCF_SUCCESS;
+	}
+
+	/* one round per interval, on an absolute schedule */
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (round = 0; round < count; round++) {
+		if (round > 0) {
+			ua_wait(&next, interval);
+		}
+		for (i = 0; i < nanns; i++) {
+			if (send_announce(&anns[i]) < 0) {
+				failed++;
+			}
+		}
+	}
+
+	return failed ? OCF_ERR_GENERIC : OCF_SUCCESS;
+}
+
+static void usage_send_announce(const char* self)
+{
+	printf("usage: %s [-i[=Interval]] [-c[=Count]] [-h] [Address Interface ...]\n"
+	       "       %s -D [-w[=Wait]] [-i[=Interval]] [-c[=Count]]\n"
+	       "          [IPv4-Address Interface ...]\n"
+	       "Without addresses, \"Address Interface\" lines are read from stdin.\n"
+	       "-D probes for the addresses instead and prints a CONFLICT line for\n"
+	       "each one another host answers for within Wait msec (default 200);\n"
+	       "probes are sent Count times (2), Interval msec (100) apart.\n"
+	       "It exits with 10 if any address is in use.\n",
+	       self, self);
+	return;
+}
+
+/* Following code is copied from send_arp.c, linux-HA project. */
+void
+byebye(int nsig)
+{
+	(void)nsig;
+	/* Avoid an "error exit" log message if we're killed */
+	exit(0);
+}
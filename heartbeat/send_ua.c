@@ -21,6 +21,7 @@
  */
 
 #include <IPv6addr.h>
+#include <announce_sched.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,9 +46,15 @@ main(int argc, char* argv[])
 	int		interval = 1000;	/* default 1000 msec */
 	int		ch;
 	int		i;
+	int		jitter = 0;
+	char*		sched_spec = NULL;
+	char		fixed_spec[32];
+	struct announce_sched sched;
+	struct timespec	next;
 	char*		cp;
 	char*		prov_ifname = NULL;
 	struct in6_addr	addr6;
+	struct ua_packet ua;
 	struct sigaction act;
 
 	/* Check binary name */
@@ -55,7 +62,7 @@ main(int argc, char* argv[])
 		usage_send_ua(argv[0]);
 		return OCF_ERR_ARGS;
 	}
-	while ((ch = getopt(argc, argv, "h?c:i:")) != EOF) {
+	while ((ch = getopt(argc, argv, "h?c:i:S:J:")) != EOF) {
 		switch(ch) {
 		case 'c': /* count option */
 			count = atoi(optarg);
@@ -63,6 +70,12 @@ main(int argc, char* argv[])
 		case 'i': /* interval option */
 			interval = atoi(optarg);
 		    break;
+		case 'S': /* schedule option */
+			sched_spec = optarg;
+		    break;
+		case 'J': /* jitter option */
+			jitter = atoi(optarg);
+		    break;
 		case 'h':
 		case '?':
 		default:
@@ -71,6 +84,17 @@ main(int argc, char* argv[])
 		}
 	}
 
+	/* a fixed interval is the schedule "0,interval" */
+	if (sched_spec == NULL) {
+		snprintf(fixed_spec, sizeof(fixed_spec), "0,%d", interval);
+		sched_spec = fixed_spec;
+	}
+	if (announce_sched_parse(&sched, sched_spec, jitter) < 0) {
+		printf("ERROR: Invalid schedule [%s] or jitter [%d]", sched_spec, jitter);
+		usage_send_ua(argv[0]);
+		return OCF_ERR_ARGS;
+	}
+
 	/* set termination signal */
 	memset(&act, 0, sizeof(struct sigaction));
 	act.sa_flags &= ~SA_RESTART; /* redundant - to stress syscalls should fail */
@@ -108,17 +132,25 @@ main(int argc, char* argv[])
 	}
 
 	/* Send unsolicited advertisement packet to neighbor */
+	if (ua_open(&ua, &addr6, prov_ifname) < 0) {
+		return OCF_ERR_GENERIC;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &next);
 	for (i = 0; i < count; i++) {
-		send_ua(&addr6, prov_ifname);
-		usleep(interval * 1000);
+		ua_wait(&next, announce_sched_delay(&sched, i));
+		ua_send(&ua);
 	}
+	ua_close(&ua);
 
 	return OCF_SUCCESS;
 }
 
 static void usage_send_ua(const char* self)
 {
-	printf("usage: %s [-i[=Interval]] [-c[=Count]] [-h] IPv6-Address Prefix Interface\n",self);
+	printf("usage: %s [-i[=Interval]] [-c[=Count]] [-S Schedule [-J Jitter]] [-h] IPv6-Address Prefix Interface\n"
+	       "  Schedule: msec to wait before each packet, e.g. 0,50,200,1000,5000\n"
+	       "            (the last one repeats); default 0,Interval\n"
+	       "  Jitter: vary each wait randomly by up to this many percent\n", self);
 	return;
 }
 
@@ -22,6 +22,8 @@
 #ifndef OCF_IPV6_HELPER_H
 #define OCF_IPV6_HELPER_H
 #include <netinet/icmp6.h>
+#include <net/if.h>
+#include <time.h>
 #include <config.h>
 /*
 0	No error, action succeeded completely
@@ -54,5 +56,24 @@
 #define  BCAST_ADDR "ff02::1"
 #define IF_INET6 "/proc/net/if_inet6"
 
+#define UA_PAYLOAD_SIZE	(sizeof(struct nd_neighbor_advert) \
+			 + sizeof(struct nd_opt_hdr) + HWADDR_LEN)
+
+/* an unsolicited neighbor advertisement, ready to be sent */
+struct ua_packet {
+	int			fd;
+	int			payload_size;
+	struct sockaddr_in6	dst;
+	char			if_name[IF_NAMESIZE];
+	u_int8_t		payload[UA_PAYLOAD_SIZE];
+};
+
+void ua_build(u_int8_t* payload, struct in6_addr* target, const void* hwaddr);
+
+int ua_open(struct ua_packet* ua, struct in6_addr* src_ip, char* if_name);
+int ua_send(struct ua_packet* ua);
+int ua_send_repeat(struct ua_packet* ua, int count, int interval);
+void ua_wait(struct timespec* next, int delay);
+void ua_close(struct ua_packet* ua);
 int send_ua(struct in6_addr* src_ip, char* if_name);
 #endif
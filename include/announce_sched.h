@@ -0,0 +1,49 @@
+/*
+ * announce_sched.h: when to send repeated address announcements
+ *
+ * send_arp and send_ua repeat their gratuitous ARPs and unsolicited
+ * neighbor advertisements.  A schedule is the list of gaps, in ms,
+ * before each packet: "0,50,200,1000,5000" sends one at once, then
+ * after 50 ms, 200 ms more and so on.  Most peers update on the first
+ * packets and the later ones cover stragglers.  The last gap repeats
+ * for any further packets.  An optional jitter (percent) spreads every
+ * gap randomly by up to that much either way, so that nodes announcing
+ * at once do not stay in step.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef RA_ANNOUNCE_SCHED_H
+#define RA_ANNOUNCE_SCHED_H
+
+#define ANNOUNCE_SCHED_MAX	32
+
+struct announce_sched {
+	int	n;
+	int	gap[ANNOUNCE_SCHED_MAX];	/* ms before packet i */
+	int	jitter;				/* percent */
+};
+
+/*
+ * Parse "gap,gap,..." (ms) with a jitter in percent into s.
+ * Returns 0, or -1 if spec is not a list of 1 to ANNOUNCE_SCHED_MAX
+ * non-negative numbers or jitter is not within 0..100.
+ */
+int announce_sched_parse(struct announce_sched *s, const char *spec, int jitter);
+
+/* the gap (ms) before packet i, counting from 0, jitter applied */
+int announce_sched_delay(const struct announce_sched *s, int i);
+
+#endif /* RA_ANNOUNCE_SCHED_H */
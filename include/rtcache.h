@@ -0,0 +1,89 @@
+/*
+ * rtcache.h: protocol of the optional route/address cache (rtcached)
+ *
+ * rtcached keeps the interface and address tables of the host up to
+ * date from rtnetlink events and remembers route lookups until the next
+ * route, rule or link change.  findif, IPv6addr and IPaddr2 ask it over
+ * a local SOCK_SEQPACKET socket, one fixed-size request and reply per
+ * packet.  When it is not running rtcache_query() fails quickly and the
+ * callers do their own lookup, as they always did.  The same goes for
+ * a caller in another network namespace than rtcached (e.g. through
+ * "ip netns exec", which shares the socket directory): every reply
+ * carries the daemon's namespace, and the client only takes answers
+ * about its own.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef RA_RTCACHE_H
+#define RA_RTCACHE_H
+
+#include <config.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#define RTCACHE_SOCKET		HA_RSCTMPDIR "/rtcached.sock"
+#define RTCACHE_VERSION		2
+#define RTCACHE_NETNS		"/proc/self/ns/net"
+#define RTCACHE_TIMEOUT		200	/* ms, then the caller falls back */
+
+/* request types */
+#define RTCACHE_ROUTE		1	/* route the kernel would use for addr */
+#define RTCACHE_ADDR		2	/* interfaces that have addr configured */
+#define RTCACHE_ONLINK		3	/* interfaces with an address whose
+					   prefix covers addr (IPv6addr's
+					   scan_if(): global addresses, and
+					   link-local ones only with ifindex) */
+
+struct rtcache_req {
+	uint8_t		version;
+	uint8_t		type;
+	uint8_t		family;		/* AF_INET or AF_INET6 */
+	uint8_t		plen;		/* ADDR, ONLINK: 0 for any */
+	int32_t		ifindex;	/* 0 for any */
+	uint8_t		addr[16];
+};
+
+#define RTCACHE_MAX_MATCH	8
+
+struct rtcache_match {
+	int32_t		ifindex;
+	uint8_t		plen;		/* route or address prefix length */
+	uint8_t		rtype;		/* ROUTE: RTN_* of the FIB entry */
+	uint8_t		scope;
+	uint8_t		pad;
+	uint32_t	flags;		/* ADDR, ONLINK: IFA_F_* */
+	char		ifname[IFNAMSIZ];
+};
+
+struct rtcache_resp {
+	int32_t		status;		/* 0 or -errno (e.g. -ENETUNREACH) */
+	uint32_t	count;
+	uint64_t	netns_dev;	/* rtcached's RTCACHE_NETNS, 0 if */
+	uint64_t	netns_ino;	/* unknown */
+	struct rtcache_match match[RTCACHE_MAX_MATCH];
+};
+
+/*
+ * Ask rtcached.  Returns 0 when it answered (the result is in
+ * resp->status and resp->match), -1 when it is not there, did not
+ * answer in time or serves another network namespace.  The connection
+ * is kept for further queries.  After a failure the cache is not asked
+ * again by this process: a batch of lookups would otherwise wait out
+ * RTCACHE_TIMEOUT for every one of them.
+ */
+int rtcache_query(const struct rtcache_req *req, struct rtcache_resp *resp);
+
+#endif /* RA_RTCACHE_H */
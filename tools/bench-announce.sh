@@ -0,0 +1,156 @@
+#!/bin/sh
+
+# Failover announcement benchmark: how long until the neighbours have
+# heard about every address.
+#
+# Runs in a private network namespace (entered via unshare, so nothing
+# on the host is touched), with the other end of a veth pair in a second
+# one where pktcount counts what arrives.  For each number of addresses
+# the IPv4 and IPv6 addresses are put on bn0 and announced by every
+# available sender: one send_arp or send_ua per address, all started at
+# once as IPaddr2 starts do, and the batched forms (send_announce, and
+# send_arp -K where the kernel announces all addresses of the device
+# once and only the -c repeats of its own address follow).
+# Reported per run: processes started, packets expected and received,
+# seconds from the start until the first and the last one arrived, and
+# the CPU time of the senders.
+#
+# Usage: bench-announce.sh [addresses ...]	(default: 10 100 1000)
+# Environment: SENDARP, SENDUA, SENDANNOUNCE, PKTCOUNT (binaries),
+#	       COUNT (announcements per address, default 1)
+
+export LC_ALL=C
+set -u
+
+HERE=$(dirname "$0")
+: "${SENDARP:=${HERE}/send_arp}"
+: "${SENDUA:=${HERE}/../heartbeat/send_ua}"
+: "${SENDANNOUNCE:=${HERE}/../heartbeat/send_announce}"
+: "${PKTCOUNT:=${HERE}/pktcount}"
+: ${COUNT:=1}
+[ $# -gt 0 ] || set -- 10 100 1000
+
+if [ -z "${BENCH_NETNS:-}" ]; then
+	BENCH_NETNS=1; export BENCH_NETNS
+	if [ "$(id -u)" -eq 0 ]; then
+		exec unshare -n /bin/sh "$0" "$@"
+	else
+		exec unshare -rn /bin/sh "$0" "$@"
+	fi
+	echo "Cannot enter a network namespace (unshare)" >&2
+	exit 1
+fi
+
+if [ ! -x "$PKTCOUNT" ]; then
+	echo "$PKTCOUNT not built, run 'make bench-announce'" >&2
+	exit 1
+fi
+for p in "$SENDARP" "$SENDUA" "$SENDANNOUNCE"; do
+	[ -x "$p" ] || echo "# $p not built, its runs are skipped"
+done
+
+TMP=$(mktemp -d) || exit 1
+unshare -n sleep 1000000 &
+PEER=$!
+trap 'kill $PEER; rm -rf "$TMP"' EXIT
+sleep 0.2
+peer () {
+	nsenter -t $PEER -n "$@"
+}
+
+# no router solicitations to count along; the peer only listens
+echo 0 > /proc/sys/net/ipv6/conf/default/router_solicitations
+peer sh -c 'echo 1 > /proc/sys/net/ipv6/conf/default/disable_ipv6'
+ip link set lo up
+ip link add bn0 type veth peer name bn1 netns $PEER || exit 1
+ip link set bn0 up
+peer ip link set bn1 up
+echo 1 > /proc/sys/net/ipv4/conf/bn0/arp_notify 2>/dev/null
+
+# children CPU time (user + sys) of a "times" snapshot, in seconds;
+# times itself must run in the shell that waited for them
+cputime () {
+	awk 'NR == 2 {
+		split($1, u, "[ms]"); split($2, s, "[ms]")
+		printf "%.3f\n", u[1] * 60 + u[2] + s[1] * 60 + s[2]
+	}' "$1"
+}
+
+printf "%-6s %-26s %6s %8s %8s %8s %8s %8s\n" \
+	addrs mode procs expected received first_s last_s cpu_s
+
+# run name procs expected proto ipproto command...: the command starts
+# the senders and waits for them
+run () {
+	name=$1 procs=$2 expect=$3 proto=$4 ipproto=$5; shift 5
+	peer "$PKTCOUNT" -i bn1 -p $proto -P $ipproto -n "$expect" -w 2000 -W 60000 > "$TMP/rx" &
+	rx=$!
+	sleep 0.3
+	t0=$(date +%s.%N)
+	(
+		times > "$TMP/t0"
+		"$@"
+		times > "$TMP/t1"
+	)
+	wait $rx
+	read rcvd first last drops < "$TMP/rx"
+	printf "%-6s %-26s %6s %8s %8s %8s %8s %8s\n" "$n" "$name" "$procs" "$expect" "$rcvd" \
+		"$(echo "$t0 $first" | awk '{ printf "%.3f", ($2 > 0 ? $2 - $1 : 0) }')" \
+		"$(echo "$t0 $last" | awk '{ printf "%.3f", ($2 > 0 ? $2 - $1 : 0) }')" \
+		"$(echo "$(cputime "$TMP/t0") $(cputime "$TMP/t1")" | awk '{ printf "%.3f", $2 - $1 }')"
+}
+
+per_addr_arp () {
+	while read addr dev; do
+		"$SENDARP" -q -U -c "$COUNT" -I $dev $addr > /dev/null 2>&1 &
+	done < "$TMP/v4"
+	wait
+}
+
+per_addr_ua () {
+	while read addr dev; do
+		"$SENDUA" -c "$COUNT" $addr 64 $dev > /dev/null 2>&1 &
+	done < "$TMP/v6"
+	wait
+}
+
+for n in "$@"; do
+	ip addr flush dev bn0
+	awk -v n="$n" 'BEGIN {
+		for (i = 0; i < n; i++)
+			printf "198.18.%d.%d bn0\n", int(i / 250), i % 250 + 1
+	}' > "$TMP/v4"
+	awk -v n="$n" 'BEGIN {
+		for (i = 0; i < n; i++)
+			printf "2001:db8:b::%x bn0\n", i + 1
+	}' > "$TMP/v6"
+	{
+		sed 's|^\([^ ]*\) \(.*\)|addr add \1/16 dev \2|' "$TMP/v4"
+		sed 's|^\([^ ]*\) \(.*\)|addr add \1/64 dev \2 nodad|' "$TMP/v6"
+	} > "$TMP/batch"
+	ip -batch "$TMP/batch" || exit 1
+	# let the MLD reports for the new addresses go by
+	sleep 2
+
+	expect=$((n * COUNT))
+	if [ -x "$SENDARP" ]; then
+		run "send_arp, one per address" $n $expect arp -1 per_addr_arp
+		if [ "$(cat /proc/sys/net/ipv4/conf/bn0/arp_notify 2>/dev/null)" = 1 ]; then
+			# the kernel announces every address once, the
+			# repeats are packets for the one address
+			run "send_arp -K (kernel)" 1 $((n + COUNT - 1)) arp -1 \
+				"$SENDARP" -q -K -U -c "$COUNT" -I bn0 "$(head -n1 "$TMP/v4" | cut -d' ' -f1)"
+		fi
+	fi
+	if [ -x "$SENDANNOUNCE" ]; then
+		run "send_announce, IPv4" 1 $expect arp -1 \
+			sh -c '"$0" -c "$1" < "$2"' "$SENDANNOUNCE" "$COUNT" "$TMP/v4"
+	fi
+	if [ -x "$SENDUA" ]; then
+		run "send_ua, one per address" $n $expect ip6 58 per_addr_ua
+	fi
+	if [ -x "$SENDANNOUNCE" ]; then
+		run "send_announce, IPv6" 1 $expect ip6 58 \
+			sh -c '"$0" -c "$1" < "$2"' "$SENDANNOUNCE" "$COUNT" "$TMP/v6"
+	fi
+done
@@ -0,0 +1,146 @@
+#!/bin/sh
+
+# Route lookup benchmark for findif.
+#
+# Runs in a private network namespace (entered via unshare, so nothing
+# on the host is touched): two veth pairs and a synthetic routing table
+# of each size in turn, made of nested prefixes of different lengths
+# and equal prefixes with different metrics on either interface.  Every
+# lookup mechanism (findif -m) is timed for one process per address and
+# for one batch (-b) over all of them, and the batch answers of all the
+# mechanisms are compared: they must pick the same interface and netmask.
+#
+# Usage: bench-findif.sh [routes ...]		(default: 1000 10000 100000)
+# Environment: FINDIF (binary), LOOKUPS (batch size), SINGLE (processes)
+
+export LC_ALL=C
+set -u
+
+HERE=$(dirname "$0")
+: "${FINDIF:=${HERE}/findif}"
+: ${LOOKUPS:=10000}
+: ${SINGLE:=200}
+[ $# -gt 0 ] || set -- 1000 10000 100000
+
+if [ -z "${BENCH_NETNS:-}" ]; then
+	BENCH_NETNS=1; export BENCH_NETNS
+	if [ "$(id -u)" -eq 0 ]; then
+		exec unshare -n /bin/sh "$0" "$@"
+	else
+		exec unshare -rn /bin/sh "$0" "$@"
+	fi
+	echo "Cannot enter a network namespace (unshare)" >&2
+	exit 1
+fi
+
+if [ ! -x "$FINDIF" ]; then
+	echo "$FINDIF not built, run 'make'" >&2
+	exit 1
+fi
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+ip link set lo up
+ip link add bf0 type veth peer name bf2 || exit 1
+ip link add bf1 type veth peer name bf3 || exit 1
+for i in bf0 bf1 bf2 bf3; do ip link set $i up; done
+ip addr add 192.0.2.1/24 dev bf0
+ip addr add 198.51.100.1/24 dev bf1
+
+MECHS="netlink proc route"
+# mechanisms this findif was built with and this system supports
+# ("route -n get" is BSD/Solaris syntax)
+usable=""
+for m in $MECHS; do
+	if echo 192.0.2.9 | "$FINDIF" -b -C -m $m 2>/dev/null | grep -q '^bf0'; then
+		usable="$usable $m"
+	else
+		echo "# mechanism $m: not supported here, skipped"
+	fi
+done
+
+now () {
+	date +%s.%N
+}
+
+elapsed () {
+	echo "$1 $2 $3" | awk '{ printf "%.3f %.1f", $2 - $1, ($2 - $1) * 1e6 / $3 }'
+}
+
+printf "%-8s %-8s %-8s %8s %10s %8s %10s %6s\n" \
+	routes mech mode lookups seconds us/op failed agree
+
+for n in "$@"; do
+	ip route flush dev bf0 proto static 2>/dev/null
+	ip route flush dev bf1 proto static 2>/dev/null
+	# route i covers 10.0.0.0 + i * 256 as a /24; every 10th also has a
+	# /26 inside it on the other interface, every 50th a second /24
+	# with a lower metric, and every 256th a /16 behind them all
+	awk -v n="$n" 'function a(x) {
+		return sprintf("%d.%d.%d.%d", int(x / 16777216), int(x / 65536) % 256,
+			int(x / 256) % 256, x % 256)
+	}
+	BEGIN {
+		via[0] = "192.0.2.254 dev bf0"; via[1] = "198.51.100.254 dev bf1"
+		for (i = 0; i < n; i++) {
+			b = 167772160 + i * 256
+			printf "route add %s/24 via %s metric 10 proto static\n", a(b), via[i % 2]
+			if (i % 10 == 0)
+				printf "route add %s/26 via %s proto static\n", a(b + 64), via[(i + 1) % 2]
+			if (i % 50 == 0)
+				printf "route add %s/24 via %s metric 5 proto static\n", a(b), via[(i + 1) % 2]
+			if (i % 256 == 0)
+				printf "route add %s/16 via %s metric 20 proto static\n", a(b), via[(i + 1) % 2]
+		}
+	}' > "$TMP/routes"
+	ip -batch "$TMP/routes" || exit 1
+
+	# hits all over the table, and a few addresses nothing routes
+	awk -v n="$n" -v m="$LOOKUPS" 'BEGIN {
+		srand(1)
+		for (j = 0; j < m; j++) {
+			if (j % 20 == 19) {
+				printf "203.0.113.%d\n", j % 250 + 1
+				continue
+			}
+			x = 167772160 + int(rand() * n) * 256 + int(rand() * 254) + 1
+			printf "%d.%d.%d.%d\n", int(x / 16777216), int(x / 65536) % 256,
+				int(x / 256) % 256, x % 256
+		}
+	}' > "$TMP/addrs"
+	head -n "$SINGLE" "$TMP/addrs" > "$TMP/single"
+	nsingle=$(wc -l < "$TMP/single")
+
+	for m in $usable; do
+		t0=$(now)
+		while read addr; do
+			OCF_RESKEY_ip=$addr "$FINDIF" -C -m $m > /dev/null 2>&1
+		done < "$TMP/single"
+		t1=$(now)
+		set -- $(elapsed $t0 $t1 $nsingle)
+		printf "%-8s %-8s %-8s %8s %10s %8s %10s %6s\n" \
+			$n $m single $nsingle $1 $2 - -
+
+		t0=$(now)
+		"$FINDIF" -C -b -m $m < "$TMP/addrs" > "$TMP/out.$m" 2>/dev/null
+		t1=$(now)
+		# the messages differ between mechanisms, failing is what counts
+		sed -i 's/^ERROR.*/ERROR/' "$TMP/out.$m"
+		failed=$(grep -c '^ERROR' "$TMP/out.$m")
+		agree=yes
+		for o in $usable; do
+			[ -f "$TMP/out.$o" ] || continue
+			if ! cmp -s "$TMP/out.$o" "$TMP/out.$m"; then
+				agree=no
+				echo "# $m and $o disagree:" >&2
+				paste -d'|' "$TMP/addrs" "$TMP/out.$o" "$TMP/out.$m" |
+					awk -F'|' '$2 != $3' | head -n 5 >&2
+			fi
+		done
+		set -- $(elapsed $t0 $t1 $LOOKUPS)
+		printf "%-8s %-8s %-8s %8s %10s %8s %10s %6s\n" \
+			$n $m batch $LOOKUPS $1 $2 $failed $agree
+	done
+	rm -f "$TMP"/out.*
+done
@@ -0,0 +1,125 @@
+#!/bin/sh
+
+# Throughput benchmark for tickle_tcp.
+#
+# Runs in a private network namespace (entered via unshare, so nothing
+# on the host is touched): a veth pair, both connection ends routed out
+# of bt0 through a static neighbour, and pktcount listening on bt1
+# counts what actually made it onto the wire.  Every transmit mode is
+# run over the same synthetic connection list.  Set BASELINE to a
+# tickle_tcp from before the batched sender (one raw socket and one
+# sendto() per packet) to have it measured on the same list first; it
+# prints no statistics, so its rate is taken from the wall clock.
+#
+# Usage: bench-tickle_tcp.sh [connections]
+# Environment: TICKLE, PKTCOUNT, BASELINE (binaries), REPEAT (-n),
+#	       RATE (paced run)
+
+export LC_ALL=C
+set -u
+
+HERE=$(dirname "$0")
+: "${TICKLE:=${HERE}/tickle_tcp}"
+: "${PKTCOUNT:=${HERE}/pktcount}"
+: "${BASELINE:=}"
+: ${REPEAT:=1}
+: ${RATE:=100000}
+NCONNS=${1:-20000}
+
+if [ -z "${BENCH_NETNS:-}" ]; then
+	BENCH_NETNS=1; export BENCH_NETNS
+	if [ "$(id -u)" -eq 0 ]; then
+		exec unshare -n /bin/sh "$0" "$@"
+	else
+		exec unshare -rn /bin/sh "$0" "$@"
+	fi
+	echo "Cannot enter a network namespace (unshare)" >&2
+	exit 1
+fi
+
+for p in "$TICKLE" "$PKTCOUNT" ${BASELINE:+"$BASELINE"}; do
+	if [ ! -x "$p" ]; then
+		echo "$p not built, run 'make bench-tickle'" >&2
+		exit 1
+	fi
+done
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+ip link set lo up
+ip link add bt0 type veth peer name bt1 || exit 1
+ip link set bt0 up
+ip link set bt1 up
+ip addr add 192.0.2.1/24 dev bt0
+# /sys still shows the parent namespace, ask ip for the peer's address
+ip neigh add 192.0.2.2 lladdr "$(ip -o link show bt1 | sed -n 's|.*link/ether \([^ ]*\).*|\1|p')" dev bt0 || exit 1
+ip route add 10.201.0.0/16 via 192.0.2.2
+ip route add 10.202.0.0/16 via 192.0.2.2
+
+# local 10.201.x.y:port <-> remote 10.202.x.y:port, none of them local,
+# so every tickle leaves through bt0
+awk -v n="$NCONNS" 'BEGIN {
+	for (i = 0; i < n; i++)
+		printf "10.201.%d.%d:%d 10.202.%d.%d:%d\n", int(i / 250) % 250,
+			i % 250 + 1, 1024 + i % 60000, int(i / 250) % 250, i % 250 + 1, 80
+}' > "$TMP/conns"
+
+# children CPU time (user + sys) of a "times" snapshot, in seconds;
+# times itself must run in this shell, not in a pipe or $(...)
+cputime () {
+	awk 'NR == 2 {
+		split($1, u, "[ms]"); split($2, s, "[ms]")
+		printf "%.3f\n", u[1] * 60 + u[2] + s[1] * 60 + s[2]
+	}' "$1"
+}
+
+printf "%-24s %9s %9s %11s %8s %9s %6s\n" \
+	mode sent seconds pps cpu_s received drops
+
+# run name binary args...
+run () {
+	name=$1 bin=$2; shift 2
+	expect=$((NCONNS * REPEAT))
+	"$PKTCOUNT" -i bt1 -p ip -P 6 -n "$expect" -w 1000 > "$TMP/rx" &
+	rx=$!
+	sleep 0.3
+	times > "$TMP/t0"
+	t0=$(date +%s.%N)
+	"$bin" -n "$REPEAT" "$@" < "$TMP/conns" 2> "$TMP/tx"
+	status=$?
+	t1=$(date +%s.%N)
+	times > "$TMP/t1"
+	c0=$(cputime "$TMP/t0")
+	c1=$(cputime "$TMP/t1")
+	wait $rx
+	sed -n 's/.* \([0-9]*\) packets sent, .* \([0-9.]*\) s, \([0-9]*\) pps.*/\1 \2 \3/p' \
+		"$TMP/tx" > "$TMP/txs"
+	# no -v statistics (the baseline): it stops at the first failure
+	if [ ! -s "$TMP/txs" ] && [ $status -eq 0 ]; then
+		echo "$expect $t0 $t1" |
+			awk '{ printf "%d %.3f %d\n", $1, $3 - $2, ($3 > $2 ? $1 / ($3 - $2) : 0) }' \
+			> "$TMP/txs"
+	fi
+	if [ ! -s "$TMP/txs" ]; then
+		printf "%-24s failed: %s\n" "$name" "$(head -n1 "$TMP/tx")"
+		return
+	fi
+	read sent secs pps < "$TMP/txs"
+	read rcvd first last drops < "$TMP/rx"
+	printf "%-24s %9s %9s %11s %8s %9s %6s\n" "$name" "$sent" "$secs" "$pps" \
+		"$(echo "$c0 $c1" | awk '{ printf "%.3f", $2 - $1 }')" "$rcvd" "$drops"
+}
+
+NCPU=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+
+if [ -n "$BASELINE" ]; then
+	run "baseline, per packet"	"$BASELINE"
+fi
+run "unbatched (-B 1)"		"$TICKLE" -v -B 1
+run "batched"			"$TICKLE" -v
+run "2 threads"			"$TICKLE" -v -t 2
+run "$NCPU threads"		"$TICKLE" -v -t "$NCPU"
+run "$NCPU threads, pinned"	"$TICKLE" -v -t "$NCPU" -a
+run "paced ${RATE}/s"		"$TICKLE" -v -r "$RATE" -b 64
+run "kill (-k)"			"$TICKLE" -v -k
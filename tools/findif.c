@@ -5,6 +5,7 @@
  *
  *	This code is dependent on IPV4 addressing conventions...
  *		Sorry.
+ *	(IPv6 addresses are handled too, but only through rtnetlink.)
  *
  * Copyright (C) 2000 Alan Robertson <alanr@unix.sh>
  * Copyright (C) 2001 Matt Soffen <matt@soffen.com>
@@ -78,6 +79,11 @@
 
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <rtcache.h>
+#endif
 #include <agent_config.h>
 #include <config.h>
 
@@ -109,6 +115,7 @@
 #endif
 
 static int OutputInCIDR=0;
+static int UseRtcache=1;	/* off when -m picks one mechanism */
 
 
 /*
@@ -128,21 +135,40 @@ typedef int SearchRoute (char *address, struct in_addr *in
 ,        unsigned long *best_netmask, char *errmsg
 ,	int errmsglen);
 
+#ifdef HAVE_LINUX_RTNETLINK_H
+static SearchRoute SearchUsingNetlink;
+#endif
 static SearchRoute SearchUsingProcRoute;
 static SearchRoute SearchUsingRouteCmd;
 
 static SearchRoute *search_mechs[] = {
+#ifdef HAVE_LINUX_RTNETLINK_H
+	&SearchUsingNetlink,
+#endif
 	&SearchUsingProcRoute,
 	&SearchUsingRouteCmd,
 	NULL
 };
 
+/* names for -m, which restricts the search to one of the above */
+static const struct {
+	const char	*name;
+	SearchRoute	*mech;
+} search_mech_names[] = {
+#ifdef HAVE_LINUX_RTNETLINK_H
+	{ "netlink",	&SearchUsingNetlink },
+#endif
+	{ "proc",	&SearchUsingProcRoute },
+	{ "route",	&SearchUsingRouteCmd },
+	{ NULL,		NULL }
+};
+
 void GetAddress (char **address, char **netmaskbits
 ,	 char **bcast_arg, char **if_specified);
 
 int ConvertNetmaskBitsToInt(char *netmaskbits);
 
-void ValidateNetmaskBits(int bits, unsigned long *netmask);
+int ValidateNetmaskBits(int bits, unsigned long *netmask);
 
 int ValidateIFName (const char *ifname, struct ifreq *ifr);
 
@@ -170,18 +196,544 @@ void usage(int ec);
 #define	BAD_BROADCAST	(0L)
 #define	MAXSTR	128
 
+#ifdef HAVE_LINUX_RTNETLINK_H
+#ifndef RTM_F_FIB_MATCH
+#define RTM_F_FIB_MATCH	0x2000
+#endif
+
+/*
+ * rtnetlink helpers.  The socket stays open, so a batch of lookups
+ * shares it; replies are matched by sequence number and anything an
+ * earlier, abandoned request left behind is skipped.
+ */
+static int	rtnl_fd = -1;
+static unsigned	rtnl_seq;
+
 static int
-SearchUsingProcRoute (char *address, struct in_addr *in
-, 	struct in_addr *addr_out, char *best_if, size_t best_iflen
+rtnl_send(struct nlmsghdr *nh)
+{
+	struct sockaddr_nl	nladdr;
+
+	if (rtnl_fd < 0) {
+		rtnl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC
+		,	NETLINK_ROUTE);
+		if (rtnl_fd < 0) {
+			return -errno;
+		}
+	}
+	nh->nlmsg_seq = ++rtnl_seq;
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(rtnl_fd, nh, nh->nlmsg_len, 0
+	,	(struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		return -errno;
+	}
+	return 0;
+}
+
+/* req is the whole request buffer, with the nlmsghdr at its start */
+static void
+rtnl_addattr(void *req, int type, const void *data, int len)
+{
+	struct nlmsghdr *nh = req;
+	struct rtattr *rta;
+
+	rta = (struct rtattr *)((char *)nh + NLMSG_ALIGN(nh->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/*
+ * Send a request and feed every reply message to cb until the request
+ * is done (NLMSG_DONE for dumps, the first reply otherwise).  A positive
+ * cb return stops early; a negative one stops too and is returned, so
+ * that a half-read dump is not taken for a whole one.  Returns 0, or
+ * -errno from the kernel or cb.
+ */
+static int
+rtnl_talk(struct nlmsghdr *req, int (*cb)(struct nlmsghdr *, void *)
+,	void *arg)
+{
+	static char	buf[32768];
+	struct nlmsghdr	*nh;
+	int	len, rc, dump = req->nlmsg_flags & NLM_F_DUMP;
+
+	if ((rc = rtnl_send(req)) < 0) {
+		return rc;
+	}
+	for (;;) {
+		len = recv(rtnl_fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned)len)
+		;	nh = NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_seq != rtnl_seq) {
+				continue;
+			}
+			if (nh->nlmsg_type == NLMSG_DONE) {
+				return 0;
+			}
+			if (nh->nlmsg_type == NLMSG_ERROR) {
+				return ((struct nlmsgerr *)NLMSG_DATA(nh))->error;
+			}
+			if ((rc = cb(nh, arg)) != 0 || !dump) {
+				/* drain the rest of a dump we stop early */
+				if (dump) {
+					while (recv(rtnl_fd, buf, sizeof(buf)
+					,	MSG_DONTWAIT) > 0)
+						;
+				}
+				return rc < 0 ? rc : 0;
+			}
+		}
+	}
+}
+
+/*
+ * Interface table: one RTM_GETLINK dump, taken the first time any
+ * interface is looked at, then searched by name or index.  This
+ * replaces an ioctl per name check and rereading /proc/net/dev, which
+ * adds up with thousands of VLANs and bridges.
+ */
+#ifndef IFLA_EXT_MASK
+#define IFLA_EXT_MASK		29
+#endif
+#ifndef RTEXT_FILTER_SKIP_STATS
+#define RTEXT_FILTER_SKIP_STATS	(1 << 3)
+#endif
+
+struct if_entry {
+	int		ifindex;
+	unsigned	flags;
+	char		name[IFNAMSIZ];
+};
+
+static struct if_entry	*if_table;	/* sorted by ifindex */
+static struct if_entry	**if_by_name;	/* sorted by name */
+static int		if_count, if_alloc;
+static int		if_loaded;	/* 1: loaded, -1: not available */
+
+static int
+if_table_cb(struct nlmsghdr *nh, void *arg)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct if_entry	*e, *tmp;
+	struct rtattr	*rta;
+	int	attrlen = IFLA_PAYLOAD(nh);
+
+	if (nh->nlmsg_type != RTM_NEWLINK) {
+		return 0;
+	}
+	if (if_count == if_alloc) {
+		tmp = realloc(if_table, (if_alloc ? if_alloc * 2 : 64)
+		*	sizeof(*if_table));
+		if (tmp == NULL) {
+			return -ENOMEM;
+		}
+		if_table = tmp;
+		if_alloc = if_alloc ? if_alloc * 2 : 64;
+	}
+	e = &if_table[if_count];
+	memset(e, 0, sizeof(*e));
+	e->ifindex = ifi->ifi_index;
+	e->flags = ifi->ifi_flags;
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == IFLA_IFNAME) {
+			strncpy(e->name, RTA_DATA(rta), sizeof(e->name) - 1);
+		}
+	}
+	if_count++;
+	return 0;
+}
+
+static int
+if_cmp_index(const void *a, const void *b)
+{
+	return ((const struct if_entry *)a)->ifindex
+	-	((const struct if_entry *)b)->ifindex;
+}
+
+static int
+if_cmp_name(const void *a, const void *b)
+{
+	return strcmp((*(struct if_entry * const *)a)->name
+	,	(*(struct if_entry * const *)b)->name);
+}
+
+static int
+if_table_load(void)
+{
+	struct {
+		struct nlmsghdr		nh;
+		struct ifinfomsg	ifi;
+		char			attrs[16];
+	} req;
+	uint32_t mask = RTEXT_FILTER_SKIP_STATS;
+	int	i;
+
+	if (if_loaded) {
+		return if_loaded;
+	}
+	if_loaded = -1;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	req.nh.nlmsg_type = RTM_GETLINK;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.ifi.ifi_family = AF_UNSPEC;
+	/* we only want names and flags, not the counters */
+	rtnl_addattr(&req, IFLA_EXT_MASK, &mask, sizeof(mask));
+	if (rtnl_talk(&req.nh, if_table_cb, NULL) < 0 || if_count == 0) {
+		if_count = 0;
+		return if_loaded;
+	}
+
+	if ((if_by_name = malloc(if_count * sizeof(*if_by_name))) == NULL) {
+		if_count = 0;
+		return if_loaded;
+	}
+	qsort(if_table, if_count, sizeof(*if_table), if_cmp_index);
+	for (i = 0; i < if_count; i++) {
+		if_by_name[i] = &if_table[i];
+	}
+	qsort(if_by_name, if_count, sizeof(*if_by_name), if_cmp_name);
+	if_loaded = 1;
+	return if_loaded;
+}
+
+static const struct if_entry *
+if_lookup_index(int ifindex)
+{
+	struct if_entry key;
+
+	key.ifindex = ifindex;
+	return bsearch(&key, if_table, if_count, sizeof(*if_table)
+	,	if_cmp_index);
+}
+
+static const struct if_entry *
+if_lookup_name(const char *name)
+{
+	struct if_entry key, *pkey = &key, **e;
+
+	strncpy(key.name, name, sizeof(key.name) - 1);
+	key.name[sizeof(key.name) - 1] = EOS;
+	e = bsearch(&pkey, if_by_name, if_count, sizeof(*if_by_name)
+	,	if_cmp_name);
+	return e ? *e : NULL;
+}
+
+/* if_indextoname() from the table, when there is one */
+static char *
+if_name_of(int ifindex, char *name)
+{
+	const struct if_entry *e;
+
+	if (if_table_load() > 0) {
+		if ((e = if_lookup_index(ifindex)) == NULL) {
+			return NULL;
+		}
+		memcpy(name, e->name, IFNAMSIZ);
+		return name;
+	}
+	return if_indextoname(ifindex, name);
+}
+
+/* if_nametoindex() likewise */
+static int
+if_index_of(const char *name)
+{
+	const struct if_entry *e;
+
+	if (if_table_load() > 0) {
+		return (e = if_lookup_name(name)) != NULL ? e->ifindex : 0;
+	}
+	return if_nametoindex(name);
+}
+
+struct rtnl_route {
+	int	type;
+	int	oif;
+	int	plen;
+	int	cloned;
+};
+
+static int
+rtnl_route_cb(struct nlmsghdr *nh, void *arg)
+{
+	struct rtnl_route *r = arg;
+	struct rtmsg	*rtm = NLMSG_DATA(nh);
+	struct rtattr	*rta;
+	int	attrlen = RTM_PAYLOAD(nh);
+
+	if (nh->nlmsg_type != RTM_NEWROUTE) {
+		return 0;
+	}
+	r->type = rtm->rtm_type;
+	r->plen = rtm->rtm_dst_len;
+	r->cloned = (rtm->rtm_flags & RTM_F_CLONED) != 0;
+	for (rta = RTM_RTA(rtm); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == RTA_OIF) {
+			r->oif = *(int *)RTA_DATA(rta);
+		} else if (rta->rta_type == RTA_MULTIPATH && !r->oif) {
+			/* several next hops: the first one decides */
+			struct rtnexthop *nhop = RTA_DATA(rta);
+
+			if (RTA_PAYLOAD(rta) >= sizeof(*nhop)) {
+				r->oif = nhop->rtnh_ifindex;
+			}
+		}
+	}
+	return 1;
+}
+
+/*
+ * Fill a request for rtcached; returns 0 and the answer in resp if it
+ * is running and could answer.
+ */
+static int
+rtcache_ask(int type, int family, const void *addr, int plen, int oif
+,	struct rtcache_resp *resp)
+{
+	struct rtcache_req q;
+
+	if (!UseRtcache) {
+		return -1;
+	}
+	memset(&q, 0, sizeof(q));
+	q.version = RTCACHE_VERSION;
+	q.type = type;
+	q.family = family;
+	q.plen = plen;
+	q.ifindex = oif;
+	memcpy(q.addr, addr, family == AF_INET6 ? 16 : 4);
+	return rtcache_query(&q, resp);
+}
+
+/*
+ * Ask the kernel which route it would use for dst (RTM_GETROUTE with
+ * RTM_F_FIB_MATCH, optionally restricted to one output interface).
+ * This is one round trip no matter how large the table is, and it goes
+ * through the policy routing rules.  rtcached's remembered answer to
+ * the same question is taken if it has one.
+ */
+static int
+rtnl_get_route(int family, const void *dst, int oif, struct rtnl_route *r)
+{
+	struct rtcache_resp resp;
+	struct {
+		struct nlmsghdr	nh;
+		struct rtmsg	rtm;
+		char		attrs[64];
+	} req;
+	int	alen = family == AF_INET6 ? 16 : 4;
+	int	rc;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	req.nh.nlmsg_type = RTM_GETROUTE;
+	req.nh.nlmsg_flags = NLM_F_REQUEST;
+	req.rtm.rtm_family = family;
+	req.rtm.rtm_dst_len = alen * 8;
+	req.rtm.rtm_flags = RTM_F_FIB_MATCH;
+	rtnl_addattr(&req, RTA_DST, dst, alen);
+	if (oif) {
+		rtnl_addattr(&req, RTA_OIF, &oif, sizeof(oif));
+	}
+
+	memset(r, 0, sizeof(*r));
+	if (rtcache_ask(RTCACHE_ROUTE, family, dst, 0, oif, &resp) == 0) {
+		if (resp.status == 0 && resp.count == 1) {
+			r->type = resp.match[0].rtype;
+			r->oif = resp.match[0].ifindex;
+			r->plen = resp.match[0].plen;
+			return 0;
+		}
+		if (resp.status == -ENETUNREACH || resp.status == -EHOSTUNREACH) {
+			return resp.status;
+		}
+		/* anything else: see for ourselves */
+	}
+
+	r->type = -1;
+	if ((rc = rtnl_talk(&req.nh, rtnl_route_cb, r)) < 0) {
+		return rc;
+	}
+	return r->type < 0 ? -EPROTO : 0;
+}
+
+/*
+ * Anything the kernel lookup can't answer the way the other mechanisms
+ * would (local or broadcast routes, kernels without RTM_F_FIB_MATCH,
+ * which return a cloned /32, netlink errors) returns <0, so that the
+ * next mechanism gets its turn.
+ */
+static int
+SearchUsingNetlink (char *address, struct in_addr *in
+,	struct in_addr *addr_out, char *best_if, size_t best_iflen
 ,	unsigned long *best_netmask
 ,	char *errmsg, int errmsglen)
+{
+	struct rtnl_route	r;
+	char	ifname[IF_NAMESIZE];
+	int	rc;
+
+	rc = rtnl_get_route(AF_INET, &in->s_addr, 0, &r);
+	if (rc == -ENETUNREACH || rc == -EHOSTUNREACH) {
+		snprintf(errmsg, errmsglen, "No route to %s\n", address);
+		return(OCF_ERR_GENERIC);
+	}
+	if (rc < 0 || r.cloned || r.type != RTN_UNICAST
+	||	!r.oif || if_name_of(r.oif, ifname) == NULL) {
+		return -1;
+	}
+
+	strncpy(best_if, ifname, best_iflen);
+	*best_netmask = r.plen
+	?	htonl(0xffffffffUL << (32 - r.plen)) : 0;
+	return(OCF_SUCCESS);
+}
+#endif /* HAVE_LINUX_RTNETLINK_H */
+
+/*
+ * /proc/net/route is read once and kept as a path-compressed binary
+ * trie: every node holds a prefix (host byte order), the route for
+ * exactly that prefix if there is one, and the subtrees for the next
+ * bit.  A lookup walks at most 33 nodes however many routes there are,
+ * so the table is parsed a single time even when we are asked about
+ * many addresses.
+ */
+struct proc_route {
+	unsigned long	mask;		/* network byte order, as in the file */
+	long		metric;
+	char		interface[MAXSTR];
+};
+
+struct route_node {
+	uint32_t		key;
+	int			plen;
+	struct proc_route	*route;
+	struct route_node	*child[2];
+};
+
+static struct route_node *proc_route_index;
+static int proc_route_loaded;
+
+#define KEYBIT(key, i)	(((key) >> (31 - (i))) & 1)
+#define PLENMASK(plen)	((plen) ? 0xffffffffU << (32 - (plen)) : 0U)
+
+static struct route_node *
+route_node_new(uint32_t key, int plen)
+{
+	struct route_node *n = calloc(1, sizeof(*n));
+
+	if (n) {
+		n->key = key & PLENMASK(plen);
+		n->plen = plen;
+	}
+	return n;
+}
+
+static int
+route_common_len(uint32_t a, uint32_t b, int max)
+{
+	int len = 0;
+
+	while (len < max && KEYBIT(a, len) == KEYBIT(b, len)) {
+		len++;
+	}
+	return len;
+}
+
+/*
+ * Insert a route; of several routes for the same prefix, the one with
+ * the lowest metric wins, as it does in the kernel.  On a tie the later
+ * line in the file wins, as it did with the linear scan.
+ */
+static int
+route_index_insert(struct route_node **pp, uint32_t key, int plen
+,	struct proc_route *r)
+{
+	struct route_node *n, *m, *leaf;
+	int common;
+
+	key &= PLENMASK(plen);
+	while ((n = *pp) != NULL) {
+		common = route_common_len(key, n->key
+		,	plen < n->plen ? plen : n->plen);
+		if (common < n->plen) {
+			/* split the compressed path above n */
+			if ((m = route_node_new(key, common)) == NULL) {
+				return -1;
+			}
+			m->child[KEYBIT(n->key, common)] = n;
+			if (common == plen) {
+				m->route = r;
+			} else {
+				if ((leaf = route_node_new(key, plen)) == NULL) {
+					free(m);
+					return -1;
+				}
+				leaf->route = r;
+				m->child[KEYBIT(key, common)] = leaf;
+			}
+			*pp = m;
+			return 0;
+		}
+		if (n->plen == plen) {
+			if (n->route == NULL || r->metric <= n->route->metric) {
+				free(n->route);
+				n->route = r;
+			} else {
+				free(r);
+			}
+			return 0;
+		}
+		pp = &n->child[KEYBIT(key, n->plen)];
+	}
+	if ((n = route_node_new(key, plen)) == NULL) {
+		return -1;
+	}
+	n->route = r;
+	*pp = n;
+	return 0;
+}
+
+static struct proc_route *
+route_index_lookup(const struct route_node *n, uint32_t key)
+{
+	struct proc_route *best = NULL;
+
+	while (n && ((key ^ n->key) & PLENMASK(n->plen)) == 0) {
+		if (n->route) {
+			best = n->route;
+		}
+		if (n->plen == 32) {
+			break;
+		}
+		n = n->child[KEYBIT(key, n->plen)];
+	}
+	return best;
+}
+
+static int
+LoadProcRoute(char *errmsg, int errmsglen)
 {
 	unsigned long	flags, refcnt, use, gw, mask;
 	unsigned long   dest;
-	long		metric = LONG_MAX;
-	long		best_metric = LONG_MAX;
+	long		metric;
+	struct proc_route *r;
 	int		rc = OCF_SUCCESS;
-	
+
 	char	buf[2048];
 	char	interface[MAXSTR];
 	FILE *routefd = NULL;
@@ -200,7 +752,6 @@ SearchUsingProcRoute (char *address, struct in_addr *in
 		,	PROCROUTE);
 		rc = OCF_ERR_GENERIC; goto out;
 	}
-	*best_netmask = 0;
 	while (fgets(buf, sizeof(buf), routefd) != NULL) {
 		if (sscanf(buf, "%[^\t]\t%lx%lx%lx%lx%lx%lx%lx"
 		,	interface, &dest, &gw, &flags, &refcnt, &use
@@ -210,18 +761,21 @@ SearchUsingProcRoute (char *address, struct in_addr *in
 			,	PROCROUTE, buf);
 			rc = OCF_ERR_GENERIC; goto out;
 		}
-		if ( (in->s_addr&mask) == (in_addr_t)(dest&mask)
-		&&	metric <= best_metric && mask >= *best_netmask) {
-			best_metric = metric;
-			*best_netmask = mask;
-			strncpy(best_if, interface, best_iflen);
+		if ((r = malloc(sizeof(*r))) == NULL) {
+			snprintf(errmsg, errmsglen, "Out of memory");
+			rc = OCF_ERR_GENERIC; goto out;
+		}
+		r->mask = mask;
+		r->metric = metric;
+		strncpy(r->interface, interface, sizeof(r->interface));
+		if (route_index_insert(&proc_route_index, ntohl(dest)
+		,	mask ? netmask_bits(ntohl(mask)) : 0, r) < 0) {
+			free(r);
+			snprintf(errmsg, errmsglen, "Out of memory");
+			rc = OCF_ERR_GENERIC; goto out;
 		}
 	}
-
-	if (best_metric == LONG_MAX) {
-		snprintf(errmsg, errmsglen, "No route to %s\n", address);
-		rc = OCF_ERR_GENERIC; 
-	}
+	proc_route_loaded = 1;
 
   out:
 	if (routefd) {
@@ -231,6 +785,31 @@ SearchUsingProcRoute (char *address, struct in_addr *in
 	return(rc);
 }
 
+static int
+SearchUsingProcRoute (char *address, struct in_addr *in
+, 	struct in_addr *addr_out, char *best_if, size_t best_iflen
+,	unsigned long *best_netmask
+,	char *errmsg, int errmsglen)
+{
+	struct proc_route *r;
+	int	rc;
+
+	if (!proc_route_loaded
+	&&	(rc = LoadProcRoute(errmsg, errmsglen)) != OCF_SUCCESS) {
+		return(rc);
+	}
+
+	/* longest prefix first, the lowest metric among equal prefixes */
+	r = route_index_lookup(proc_route_index, ntohl(in->s_addr));
+	if (r == NULL) {
+		snprintf(errmsg, errmsglen, "No route to %s\n", address);
+		return(OCF_ERR_GENERIC);
+	}
+	*best_netmask = r->mask;
+	strncpy(best_if, r->interface, best_iflen);
+	return(OCF_SUCCESS);
+}
+
 static int
 SearchUsingRouteCmd (char *address, struct in_addr *in
 ,	struct in_addr *addr_out, char *best_if, size_t best_iflen
@@ -394,23 +973,20 @@ ConvertNetmaskBitsToInt(char *netmaskbits)
 		return atoi(netmaskbits);
 }
 
-void
+int
 ValidateNetmaskBits(int bits, unsigned long *netmask)
 {
 	/* Maximum netmask is 32 */
 
 	if (bits < 1 || bits > 32) {
-		fprintf(stderr
-		,	"Invalid netmask specification [%d]"
-		,	bits);
-		usage(OCF_ERR_CONFIGURED);
-		/*not reached */
+		return -1;
 	}
 
 	bits = 32 - bits;
 	*netmask = (1L<<(bits))-1L;
 	*netmask = ((~(*netmask))&0xffffffffUL);
 	*netmask = htonl(*netmask);
+	return 0;
 }
 
 int
@@ -419,11 +995,6 @@ ValidateIFName(const char *ifname, struct ifreq *ifr)
  	int skfd = -1;
 	char *colonptr;
 
- 	if ( (skfd = socket(PF_INET, SOCK_DGRAM, 0)) == -1 ) {
- 		fprintf(stderr, "%s\n", strerror(errno));
- 		return -2;
- 	}
- 
 	strncpy(ifr->ifr_name, ifname, IFNAMSIZ - 1);
 	*(ifr->ifr_name + sizeof(ifr->ifr_name) - 1) = '\0';
 
@@ -432,6 +1003,31 @@ ValidateIFName(const char *ifname, struct ifreq *ifr)
 		fprintf(stderr, "%s: warning: name may be invalid\n",
 		  ifr->ifr_name);
 	}
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+	if (if_table_load() > 0) {
+		const struct if_entry *e;
+		char base[IFNAMSIZ];
+
+		/* like SIOCGIFFLAGS, an alias label gets its device's flags */
+		memcpy(base, ifr->ifr_name, sizeof(base));
+		if ((colonptr = strchr(base, ':')) != NULL) {
+			*colonptr = EOS;
+		}
+		if ((e = if_lookup_name(base)) == NULL) {
+			fprintf(stderr, "%s: unknown interface: %s\n"
+				, ifr->ifr_name, strerror(ENODEV));
+			return -1;
+		}
+		ifr->ifr_flags = e->flags;
+		return 0;
+	}
+#endif
+
+ 	if ( (skfd = socket(PF_INET, SOCK_DGRAM, 0)) == -1 ) {
+ 		fprintf(stderr, "%s\n", strerror(errno));
+ 		return -2;
+ 	}
  
  	if (ioctl(skfd, SIOCGIFFLAGS, ifr) < 0) {
  		fprintf(stderr, "%s: unknown interface: %s\n"
@@ -472,6 +1068,21 @@ get_first_loopback_netdev(char * output)
 		goto out;
 	}
 
+#ifdef HAVE_LINUX_RTNETLINK_H
+	/* the table is in ifindex order, as /proc/net/dev is */
+	if (if_table_load() > 0) {
+		int i;
+
+		for (i = 0; i < if_count; i++) {
+			if (if_table[i].flags & IFF_LOOPBACK) {
+				memcpy(output, if_table[i].name, IFNAMSIZ);
+				return output;
+			}
+		}
+		return NULL;
+	}
+#endif
+
 	fd = fopen(PATH_PROC_NET_DEV, "r");
 	if (!fd) {
 		fprintf(stderr, "Warning: cannot open %s (%s).\n",
@@ -559,62 +1170,220 @@ int ConvertQuadToInt(char *dest)
 	return netmask_bits(ntohl(ad.s_addr));
 }
 
-int
-main(int argc, char ** argv) {
+#ifdef HAVE_LINUX_RTNETLINK_H
+struct addr6_match {
+	struct in6_addr	addr;
+	int		ifindex;
+	int		plen;
+};
 
-	char *	address = NULL;
-	char *	bcast_arg = NULL;
-	char *	netmaskbits = NULL;
+static int
+addr6_match_cb(struct nlmsghdr *nh, void *arg)
+{
+	struct addr6_match *m = arg;
+	struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	struct rtattr	*rta;
+	int	attrlen = IFA_PAYLOAD(nh);
+
+	if (nh->nlmsg_type != RTM_NEWADDR || ifa->ifa_family != AF_INET6
+	||	(m->ifindex && m->ifindex != (int)ifa->ifa_index)) {
+		return 0;
+	}
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == IFA_ADDRESS
+		&&	memcmp(RTA_DATA(rta), &m->addr, sizeof(m->addr)) == 0) {
+			m->ifindex = ifa->ifa_index;
+			m->plen = ifa->ifa_prefixlen;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* interface and prefix length of an address that is already configured */
+static int
+rtnl_find_addr6(const struct in6_addr *addr, int oif, struct rtnl_route *r)
+{
+	struct {
+		struct nlmsghdr	nh;
+		struct ifaddrmsg ifa;
+	} req;
+	struct addr6_match m;
+	struct rtcache_resp resp;
+	int	rc;
+
+	if (rtcache_ask(RTCACHE_ADDR, AF_INET6, addr, 0, oif, &resp) == 0
+	&&	resp.status == 0) {
+		r->type = RTN_UNICAST;
+		r->oif = resp.match[0].ifindex;
+		r->plen = resp.match[0].plen;
+		return 0;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+	req.nh.nlmsg_type = RTM_GETADDR;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.ifa.ifa_family = AF_INET6;
+	req.ifa.ifa_index = oif;
+
+	memset(&m, 0, sizeof(m));
+	m.addr = *addr;
+	m.ifindex = oif;
+	m.plen = -1;
+	if ((rc = rtnl_talk(&req.nh, addr6_match_cb, &m)) < 0) {
+		return rc;
+	}
+	if (m.plen < 0) {
+		return -ENOENT;
+	}
+	r->type = RTN_UNICAST;
+	r->oif = m.ifindex;
+	r->plen = m.plen;
+	return 0;
+}
+
+/*
+ * IPv6: the kernel's route lookup again, restricted to the given nic
+ * if there is one, which is what makes link-local addresses work.  If
+ * the address is configured already, the lookup ends in the local
+ * table and the prefix length of the address itself is used instead.
+ * IPv6 has no broadcast address, so that field stays empty.
+ */
+static int
+FindIF6(char *address, char *netmaskbits, char *if_specified
+,	char *out, size_t outlen
+,	char *errmsg, int errmsglen, int *badarg)
+{
+	struct in6_addr	in6;
+	struct rtnl_route r;
+	struct ifreq	ifr;
+	char	best_if[IF_NAMESIZE];
+	int	plen = -1, oif = 0, rc;
+
+	memset(&ifr, 0, sizeof(ifr));
+	if (inet_pton(AF_INET6, address, &in6) <= 0) {
+		snprintf(errmsg, errmsglen, "IP address [%s] not valid.", address);
+		*badarg = 1;
+		return(OCF_ERR_CONFIGURED);
+	}
+
+	if (netmaskbits != NULL && *netmaskbits != EOS) {
+		size_t	nmblen = strnlen(netmaskbits, 4);
+
+		if (nmblen > 3 || strspn(netmaskbits, "0123456789") != nmblen
+		||	(plen = atoi(netmaskbits)) < 1 || plen > 128) {
+			snprintf(errmsg, errmsglen
+			,	"Invalid netmask specification [%s].", netmaskbits);
+			*badarg = 1;
+			return(OCF_ERR_CONFIGURED);
+		}
+	}
+
+	if (if_specified != NULL && *if_specified != EOS) {
+		if (ValidateIFName(if_specified, &ifr) < 0
+		||	(oif = if_index_of(if_specified)) == 0) {
+			snprintf(errmsg, errmsglen
+			,	"Invalid interface [%s].\n", if_specified);
+			*badarg = 1;
+			return(OCF_ERR_CONFIGURED);
+		}
+		strncpy(best_if, if_specified, sizeof(best_if) - 1);
+		best_if[sizeof(best_if) - 1] = EOS;
+		if (plen > 0) {
+			/* nothing left to look up */
+			goto found;
+		}
+	} else if (IN6_IS_ADDR_LINKLOCAL(&in6)) {
+		snprintf(errmsg, errmsglen, "'nic' parameter is mandatory"
+		" for a link local address [%s].", address);
+		*badarg = 1;
+		return(OCF_ERR_CONFIGURED);
+	}
+
+	rc = rtnl_get_route(AF_INET6, &in6, oif, &r);
+	if (rc == 0 && r.type == RTN_LOCAL) {
+		rc = rtnl_find_addr6(&in6, oif, &r);
+	}
+	if (rc == -ENETUNREACH || rc == -EHOSTUNREACH) {
+		snprintf(errmsg, errmsglen, "No route to %s\n", address);
+		return(OCF_ERR_GENERIC);
+	}
+	if (rc < 0 || r.type != RTN_UNICAST || !r.oif
+	||	(oif && r.oif != oif)) {
+		snprintf(errmsg, errmsglen, "Unable to find nic or netmask.\n");
+		return(OCF_ERR_GENERIC);
+	}
+	if (!oif && if_name_of(r.oif, best_if) == NULL) {
+		snprintf(errmsg, errmsglen, "Unable to find nic or netmask.\n");
+		return(OCF_ERR_GENERIC);
+	}
+	if (plen < 0) {
+		if (r.plen == 0) {
+			snprintf(errmsg, errmsglen
+			,	"ERROR: Cannot use default route w/o netmask [%s]\n"
+			,	 address);
+			return(OCF_ERR_GENERIC);
+		}
+		plen = r.plen;
+	}
+
+  found:
+	snprintf(out, outlen, "%s\tnetmask %d\tbroadcast ", best_if, plen);
+	return(0);
+}
+#endif /* HAVE_LINUX_RTNETLINK_H */
+
+/*
+ * Find the interface, netmask and broadcast address for one address
+ * and format them into out.  This never exits: bad arguments come back
+ * as OCF_ERR_CONFIGURED with *badarg set, so that a single lookup can
+ * still print the usage text and a batch can go on with the next line.
+ */
+static int
+FindIF(char *address, char *netmaskbits, char *bcast_arg
+,	char *if_specified, char *out, size_t outlen
+,	char *errmsg, int errmsglen, int *badarg)
+{
 	struct in_addr	in;
 	struct in_addr	addr_out;
 	unsigned long	netmask = 0;
 	char	best_if[MAXSTR];
-	char *	if_specified = NULL;
 	struct ifreq	ifr;
 	unsigned long	best_netmask = UINT_MAX;
-	int		argerrs	= 0;
 	int		nmbits;
 
-	cmdname=argv[0];
-
-
 	memset(&addr_out, 0, sizeof(addr_out));
 	memset(&in, 0, sizeof(in));
 	memset(&ifr, 0, sizeof(ifr));
+	*errmsg = EOS;
+	*badarg = 0;
 
-	switch (argc) {
-	case 1:	/* No -C argument */
-		break;
-	case 2: /* Hopefully a -C argument */
-		if (strncmp(argv[1], "-C", sizeof("-C")) != 0) {
-			argerrs=1;
-		}
-		OutputInCIDR=1;
-		break;
-	default:
-		argerrs=1;
-		break;
-	}
-	if (argerrs) {
-		usage(OCF_ERR_ARGS);
-		/* not reached */
-		return(1);
+	if (address == NULL || *address == EOS) {
+		snprintf(errmsg, errmsglen
+		,	"ERROR: IP address parameter is mandatory.");
+		*badarg = 1;
+		return(OCF_ERR_CONFIGURED);
 	}
 
-	GetAddress (&address, &netmaskbits, &bcast_arg
-	,	 &if_specified);
-	if (address == NULL || *address == EOS) {
-		fprintf(stderr, "ERROR: IP address parameter is mandatory.");
-		usage(OCF_ERR_CONFIGURED);
-		/* not reached */
+	if (strchr(address, ':') != NULL) {
+#ifdef HAVE_LINUX_RTNETLINK_H
+		return FindIF6(address, netmaskbits, if_specified
+		,	out, outlen, errmsg, errmsglen, badarg);
+#else
+		snprintf(errmsg, errmsglen
+		,	"IPv6 address [%s] not supported here.", address);
+		return(OCF_ERR_UNIMPLEMENTED);
+#endif
 	}
 
 	/* Is the IP address we're supposed to find valid? */
 	 
 	if (inet_pton(AF_INET, address, (void *)&in) <= 0) {
-		fprintf(stderr, "IP address [%s] not valid.", address);
-		usage(OCF_ERR_CONFIGURED);
-		/* not reached */
+		snprintf(errmsg, errmsglen, "IP address [%s] not valid.", address);
+		*badarg = 1;
+		return(OCF_ERR_CONFIGURED);
 	}
 
 	if (netmaskbits != NULL && *netmaskbits != EOS) {
@@ -626,45 +1395,50 @@ main(int argc, char ** argv) {
 		}
 
 		if (nmbits < 0) {
-			fprintf(stderr, "Invalid netmask specification"
+			snprintf(errmsg, errmsglen, "Invalid netmask specification"
 			" [%s]", netmaskbits);
-			usage(OCF_ERR_CONFIGURED);
-			/*not reached */
+			*badarg = 1;
+			return(OCF_ERR_CONFIGURED);
 		}
 
 		/* Validate the netmaskbits field */
-		ValidateNetmaskBits (nmbits, &netmask);
+		if (ValidateNetmaskBits (nmbits, &netmask) < 0) {
+			snprintf(errmsg, errmsglen
+			,	"Invalid netmask specification [%d]"
+			,	nmbits);
+			*badarg = 1;
+			return(OCF_ERR_CONFIGURED);
+		}
 	}
 
 
 	if (if_specified != NULL && *if_specified != EOS) {
 		if(ValidateIFName(if_specified, &ifr) < 0) {
-			usage(OCF_ERR_CONFIGURED);
-			/* not reached */
+			snprintf(errmsg, errmsglen
+			,	"Invalid interface [%s].\n", if_specified);
+			*badarg = 1;
+			return(OCF_ERR_CONFIGURED);
 		}
 		strncpy(best_if, if_specified, sizeof(best_if) - 1);
 		*(best_if + sizeof(best_if) - 1) = '\0';
 	}else{
 		SearchRoute **sr = search_mechs;
-		char errmsg[MAXSTR] = "No valid mechanisms";
 		int rc = OCF_ERR_GENERIC;
 
+		snprintf(errmsg, errmsglen, "No valid mechanisms");
 		strcpy(best_if, "UNKNOWN");
 
 		while (*sr) {
 			errmsg[0] = '\0';
 			rc = (*sr) (address, &in, &addr_out, best_if
 			,	sizeof(best_if)
-			,	&best_netmask, errmsg, sizeof(errmsg));
+			,	&best_netmask, errmsg, errmsglen);
 			if (!rc) {		/* Mechanism worked */
 				break;
 			}
 			sr++;
 		}
 		if (rc != 0) {	/* No route, or all mechanisms failed */
-			if (*errmsg) {
-				fprintf(stderr, "%s", errmsg);
-			}
 			return(rc);
 		}
 	}
@@ -681,11 +1455,12 @@ main(int argc, char ** argv) {
 			if (NULL != get_first_loopback_netdev(best_if)) {
 				best_netmask = 0x000000ff;
 			} else {
-				fprintf(stderr, "No loopback interface found.\n");
+				snprintf(errmsg, errmsglen
+				,	"No loopback interface found.\n");
 				return(OCF_ERR_GENERIC);
 			}
 		} else {
-			fprintf(stderr
+			snprintf(errmsg, errmsglen
 			,	"ERROR: Cannot use default route w/o netmask [%s]\n"
 			,	 address);
 			return(OCF_ERR_GENERIC);
@@ -700,14 +1475,15 @@ main(int argc, char ** argv) {
 		 */
  		struct in_addr bcast_addr;
  		if (inet_pton(AF_INET, bcast_arg, (void *)&bcast_addr) <= 0) {
- 			fprintf(stderr, "Invalid broadcast address [%s].", bcast_arg);
- 			usage(OCF_ERR_CONFIGURED);
-			/* not reached */
+ 			snprintf(errmsg, errmsglen
+			,	"Invalid broadcast address [%s].", bcast_arg);
+			*badarg = 1;
+			return(OCF_ERR_CONFIGURED);
  		}
 
 		best_netmask = htonl(best_netmask);
 		if (!OutputInCIDR) {
-			printf("%s\tnetmask %d.%d.%d.%d\tbroadcast %s\n"
+			snprintf(out, outlen, "%s\tnetmask %d.%d.%d.%d\tbroadcast %s"
 			,	best_if
                 	,       (int)((best_netmask>>24) & 0xff)
                 	,       (int)((best_netmask>>16) & 0xff)
@@ -715,7 +1491,7 @@ main(int argc, char ** argv) {
                 	,       (int)(best_netmask & 0xff)
 			,	bcast_arg);
 		}else{
-			printf("%s\tnetmask %d\tbroadcast %s\n"
+			snprintf(out, outlen, "%s\tnetmask %d\tbroadcast %s"
 			,	best_if
 			,	netmask_bits(best_netmask)
 			,	bcast_arg);
@@ -735,7 +1511,7 @@ main(int argc, char ** argv) {
 		best_netmask = htonl(best_netmask);
 		def_bcast = htonl(def_bcast);
 		if (!OutputInCIDR) {
-			printf("%s\tnetmask %d.%d.%d.%d\tbroadcast %d.%d.%d.%d\n"
+			snprintf(out, outlen, "%s\tnetmask %d.%d.%d.%d\tbroadcast %d.%d.%d.%d"
 			,       best_if
 			,       (int)((best_netmask>>24) & 0xff)
 			,       (int)((best_netmask>>16) & 0xff)
@@ -746,7 +1522,7 @@ main(int argc, char ** argv) {
 			,       (int)((def_bcast>>8) & 0xff)
 			,       (int)(def_bcast & 0xff));
 		}else{
-			printf("%s\tnetmask %d\tbroadcast %d.%d.%d.%d\n"
+			snprintf(out, outlen, "%s\tnetmask %d\tbroadcast %d.%d.%d.%d"
 			,       best_if
 			,	netmask_bits(best_netmask)
 			,       (int)((def_bcast>>24) & 0xff)
@@ -758,18 +1534,168 @@ main(int argc, char ** argv) {
 	return(0);
 }
 
+/*
+ * Batch mode: every input line is "ip [cidr [nic [broadcast]]]", with
+ * "-" for a field that is not set.  Every line gets exactly one output
+ * line, either the usual result or "ERROR<tab>rc<tab>message", and all
+ * of them are answered from the same route snapshot.  Blank lines and
+ * lines starting with '#' are skipped.
+ *
+ * No agent feeds it yet: each IPaddr2 in a group is a process of its
+ * own and knows only its address.  It serves scripts that know the
+ * whole list (bench-findif.sh does); within the agents, rtcached is
+ * what spares the repeated table reads.
+ */
+static int
+FindIFBatch(FILE *f)
+{
+	char	line[1024];
+	char	out[MAXSTR * 2];
+	char	errmsg[MAXSTR * 2];
+	char	*field[4], *tok, *nl;
+	int	nfields, i, rc, badarg, failed = 0;
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		nfields = 0;
+		for (tok = strtok(line, " \t\n"); tok != NULL
+		;	tok = strtok(NULL, " \t\n")) {
+			if (nfields == 4) {
+				nfields++;
+				break;
+			}
+			field[nfields++] = strcmp(tok, "-") ? tok : NULL;
+		}
+		if (nfields == 0 || (field[0] && *field[0] == '#')) {
+			continue;
+		}
+		for (i = nfields; i < 4; i++) {
+			field[i] = NULL;
+		}
+
+		if (nfields > 4) {
+			rc = OCF_ERR_CONFIGURED;
+			snprintf(errmsg, sizeof(errmsg), "Too many fields");
+		} else {
+			rc = FindIF(field[0], field[1], field[3], field[2]
+			,	out, sizeof(out), errmsg, sizeof(errmsg), &badarg);
+		}
+		if (rc == 0) {
+			printf("%s\n", out);
+		} else {
+			if (*errmsg == EOS) {
+				snprintf(errmsg, sizeof(errmsg), "failed");
+			}
+			while ((nl = strchr(errmsg, '\n')) != NULL) {
+				*nl = ' ';
+			}
+			for (nl = errmsg + strlen(errmsg)
+			;	nl > errmsg && isspace((int)nl[-1]); nl--) {
+				nl[-1] = EOS;
+			}
+			printf("ERROR\t%d\t%s\n", rc, errmsg);
+			failed++;
+		}
+		fflush(stdout);
+	}
+	return(failed ? OCF_ERR_GENERIC : OCF_SUCCESS);
+}
+
+int
+main(int argc, char ** argv) {
+
+	char *	address = NULL;
+	char *	bcast_arg = NULL;
+	char *	netmaskbits = NULL;
+	char *	if_specified = NULL;
+	char	out[MAXSTR * 2];
+	char	errmsg[MAXSTR * 2];
+	int	batch = 0, badarg = 0;
+	int	optchar, rc, i;
+
+	cmdname=argv[0];
+
+	while ((optchar = getopt(argc, argv, "Cbm:h")) != EOF) {
+		switch (optchar) {
+		case 'C':
+			OutputInCIDR=1;
+			break;
+		case 'b':
+			batch=1;
+			break;
+		case 'm':
+			for (i = 0; search_mech_names[i].name != NULL; i++) {
+				if (strcmp(optarg, search_mech_names[i].name) == 0) {
+					break;
+				}
+			}
+			if (search_mech_names[i].name == NULL) {
+				fprintf(stderr, "Unknown mechanism: %s\n", optarg);
+				usage(OCF_ERR_ARGS);
+				/* not reached */
+			}
+			search_mechs[0] = search_mech_names[i].mech;
+			search_mechs[1] = NULL;
+			/* measure or check this one, not the daemon */
+			UseRtcache = 0;
+			break;
+		case 'h':
+			usage(OCF_SUCCESS);
+			/* not reached */
+		default:
+			usage(OCF_ERR_ARGS);
+			/* not reached */
+		}
+	}
+	if (optind != argc) {
+		usage(OCF_ERR_ARGS);
+		/* not reached */
+		return(1);
+	}
+
+	if (batch) {
+		return(FindIFBatch(stdin));
+	}
+
+	GetAddress (&address, &netmaskbits, &bcast_arg
+	,	 &if_specified);
+	rc = FindIF(address, netmaskbits, bcast_arg, if_specified
+	,	out, sizeof(out), errmsg, sizeof(errmsg), &badarg);
+	if (rc != 0) {
+		if (*errmsg) {
+			fprintf(stderr, "%s", errmsg);
+		}
+		if (badarg) {
+			usage(rc);
+			/* not reached */
+		}
+		return(rc);
+	}
+	printf("%s\n", out);
+	return(0);
+}
+
 void
 usage(int ec)
 {
 	fprintf(stderr, "\n"
 		"%s version 2.99.1 Copyright Alan Robertson\n"
 		"\n"
-		"Usage: %s [-C]\n"
+		"Usage: %s [-C] [-b] [-m mechanism]\n"
 		"Options:\n"
 		"    -C: Output netmask as the number of bits rather "
 			"than as 4 octets.\n"
+		"    -b: Batch mode, read \"ip [cidr [nic [broadcast]]]\" "
+			"lines from stdin\n"
+		"        (\"-\" for unset fields) and print one result "
+			"line for each.\n"
+		"    -m: Only look the route up with this mechanism:\n"
+		"        "
+#ifdef HAVE_LINUX_RTNETLINK_H
+			"netlink, "
+#endif
+			"proc (/proc/net/route) or route (route command).\n"
 		"Environment variables:\n"
-		"OCF_RESKEY_ip		 ip address (mandatory!)\n"
+		"OCF_RESKEY_ip		 ip address (mandatory!), IPv4 or IPv6\n"
 		"OCF_RESKEY_cidr_netmask netmask of interface\n"
 		"OCF_RESKEY_broadcast	 broadcast address for interface\n"
 		"OCF_RESKEY_nic		 interface to assign to\n"
@@ -0,0 +1,160 @@
+/*
+   Count packets arriving on an interface
+
+   Benchmark helper: opens a packet socket on one interface, counts
+   the frames of a given ethertype (optionally only one IP protocol)
+   and prints "count first last drops" once the expected number of
+   packets has arrived or the line has been idle long enough.  The
+   timestamps are CLOCK_REALTIME seconds so a script can relate them
+   to its own "date +%s.%N".
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int parse_proto(const char *s)
+{
+	if (strcmp(s, "ip") == 0)
+		return ETH_P_IP;
+	if (strcmp(s, "ip6") == 0)
+		return ETH_P_IPV6;
+	if (strcmp(s, "arp") == 0)
+		return ETH_P_ARP;
+	return (int)strtol(s, NULL, 0);
+}
+
+/* IP protocol of an IPv4/IPv6 frame, -1 if it cannot be told */
+static int ip_proto(int proto, const unsigned char *p, ssize_t len)
+{
+	if (proto == ETH_P_IP && len >= 20)
+		return p[9];
+	if (proto == ETH_P_IPV6 && len >= 40)
+		return p[6];
+	return -1;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: pktcount -i ifname [-p ip|ip6|arp|ethertype] [-P ipproto]\n"
+		"                [-n count] [-w idle-ms] [-W max-ms]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_ll sll;
+	struct tpacket_stats st;
+	struct pollfd pfd;
+	socklen_t stlen = sizeof(st);
+	unsigned char buf[2048];
+	const char *ifname = NULL;
+	int proto = ETH_P_ALL, ipproto = -1, idle = 1000, maxwait = 30000;
+	int optchar, fd, rcvbuf = 16 << 20;
+	unsigned long want = 0, count = 0;
+	double start, first = 0, last = 0;
+
+	while ((optchar = getopt(argc, argv, "i:p:P:n:w:W:h")) != EOF) {
+		switch (optchar) {
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'p':
+			proto = parse_proto(optarg);
+			break;
+		case 'P':
+			ipproto = atoi(optarg);
+			break;
+		case 'n':
+			want = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			idle = atoi(optarg);
+			break;
+		case 'W':
+			maxwait = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (ifname == NULL || proto <= 0)
+		usage();
+
+	fd = socket(AF_PACKET, SOCK_DGRAM, htons(proto));
+	if (fd == -1) {
+		fprintf(stderr, "Failed to open packet socket (%s)\n", strerror(errno));
+		return 1;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) == -1)
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(proto);
+	sll.sll_ifindex = if_nametoindex(ifname);
+	if (sll.sll_ifindex == 0 || bind(fd, (struct sockaddr *)&sll, sizeof(sll)) == -1) {
+		fprintf(stderr, "Failed to bind to %s (%s)\n", ifname, strerror(errno));
+		return 1;
+	}
+	/* reset the counters, only what arrives from now on matters */
+	getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &st, &stlen);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	start = now();
+	while (want == 0 || count < want) {
+		double t = now();
+		int timeout = count ? idle : (int)(maxwait - (t - start) * 1000);
+		ssize_t len;
+
+		if (timeout <= 0 || poll(&pfd, 1, timeout) <= 0)
+			break;
+		while ((len = recv(fd, buf, sizeof(buf), MSG_DONTWAIT)) >= 0) {
+			if (ipproto >= 0 && ip_proto(proto, buf, len) != ipproto)
+				continue;
+			last = now();
+			if (count++ == 0)
+				first = last;
+		}
+		if ((double)(now() - start) * 1000 > maxwait)
+			break;
+	}
+
+	stlen = sizeof(st);
+	if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &st, &stlen) == -1)
+		st.tp_drops = 0;
+	printf("%lu %.6f %.6f %u\n", count, first, last, st.tp_drops);
+	close(fd);
+	return 0;
+}
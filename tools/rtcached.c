@@ -0,0 +1,832 @@
+/*
+ * rtcached: route and address cache for the IP address agents
+ *
+ * Optional helper.  It subscribes to the rtnetlink link, address,
+ * route and rule groups, keeps the interface and address tables up to
+ * date from the events, and remembers the kernel's answer to route
+ * lookups until the next route, rule or link change.  findif, IPv6addr
+ * and IPaddr2 ask it over RTCACHE_SOCKET (see rtcache.h) instead of
+ * reading /proc or dumping tables on every action, and do their own
+ * lookup when it is not running.
+ *
+ * Route answers are cached rather than computed from a private copy
+ * of the routing tables: only the kernel knows how its policy rules
+ * resolve, and a cached answer is exact until something changes.
+ *
+ *	rtcached [-f] [-v]		run the cache (-f: stay in foreground)
+ *	rtcached -q route ADDR [nic]	ask it, print "nic plen" lines;
+ *	rtcached -q addr ADDR [plen [nic]]	exit 0 if found, 1 if not,
+ *	rtcached -q onlink ADDR [plen [nic]]	3 if rtcached is not running
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <syslog.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <rtcache.h>
+
+#ifndef RTM_F_FIB_MATCH
+#define RTM_F_FIB_MATCH		0x2000
+#endif
+
+#define MAX_CLIENTS		64
+#define LINK_HASH		256
+#define ROUTE_CACHE_SIZE	4096	/* power of two */
+
+struct link {
+	int		ifindex;
+	char		name[IFNAMSIZ];
+	struct link	*next;
+};
+
+struct addr {
+	int		family;
+	int		ifindex;
+	int		plen;
+	int		scope;
+	uint32_t	flags;
+	uint8_t		addr[16];
+	struct addr	*next;
+};
+
+struct route_entry {
+	unsigned		gen;
+	struct rtcache_req	req;
+	struct rtcache_resp	resp;
+};
+
+static struct link	*links[LINK_HASH];
+static struct addr	*addrs;
+static struct route_entry *route_cache;
+static unsigned		route_gen = 1;
+
+static int	ev_fd = -1;	/* events */
+static int	rq_fd = -1;	/* our own dumps and lookups */
+static unsigned	rq_seq;
+static struct stat	netns;	/* ours, sent with every answer */
+static int	verbose;
+static volatile sig_atomic_t	stop;
+
+static int
+addr_len(int family)
+{
+	return family == AF_INET6 ? 16 : 4;
+}
+
+/*
+ * Tables
+ */
+static struct link *
+link_find(int ifindex)
+{
+	struct link *l;
+
+	for (l = links[ifindex % LINK_HASH]; l; l = l->next) {
+		if (l->ifindex == ifindex) {
+			return l;
+		}
+	}
+	return NULL;
+}
+
+static void
+link_name(int ifindex, char *name)
+{
+	struct link *l = link_find(ifindex);
+
+	if (l) {
+		memcpy(name, l->name, IFNAMSIZ);
+	} else {
+		memset(name, 0, IFNAMSIZ);
+	}
+}
+
+static void
+link_del(int ifindex)
+{
+	struct link **pl, *l;
+	struct addr **pa, *a;
+
+	for (pl = &links[ifindex % LINK_HASH]; (l = *pl) != NULL; ) {
+		if (l->ifindex == ifindex) {
+			*pl = l->next;
+			free(l);
+		} else {
+			pl = &l->next;
+		}
+	}
+	for (pa = &addrs; (a = *pa) != NULL; ) {
+		if (a->ifindex == ifindex) {
+			*pa = a->next;
+			free(a);
+		} else {
+			pa = &a->next;
+		}
+	}
+}
+
+static void
+tables_clear(void)
+{
+	struct link *l;
+	struct addr *a;
+	int i;
+
+	for (i = 0; i < LINK_HASH; i++) {
+		while ((l = links[i]) != NULL) {
+			links[i] = l->next;
+			free(l);
+		}
+	}
+	while ((a = addrs) != NULL) {
+		addrs = a->next;
+		free(a);
+	}
+}
+
+static void
+handle_link(struct nlmsghdr *nh)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct rtattr	*rta;
+	struct link	*l;
+	int	attrlen = IFLA_PAYLOAD(nh);
+
+	if (nh->nlmsg_type == RTM_DELLINK) {
+		link_del(ifi->ifi_index);
+		return;
+	}
+	if ((l = link_find(ifi->ifi_index)) == NULL) {
+		if ((l = calloc(1, sizeof(*l))) == NULL) {
+			return;
+		}
+		l->ifindex = ifi->ifi_index;
+		l->next = links[l->ifindex % LINK_HASH];
+		links[l->ifindex % LINK_HASH] = l;
+	}
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == IFLA_IFNAME) {
+			strncpy(l->name, RTA_DATA(rta), sizeof(l->name) - 1);
+		}
+	}
+}
+
+static void
+handle_addr(struct nlmsghdr *nh)
+{
+	struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	struct rtattr	*rta;
+	struct addr	key, **pa, *a;
+	const void	*local = NULL, *address = NULL;
+	int	attrlen = IFA_PAYLOAD(nh);
+
+	if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6) {
+		return;
+	}
+	memset(&key, 0, sizeof(key));
+	key.family = ifa->ifa_family;
+	key.ifindex = ifa->ifa_index;
+	key.plen = ifa->ifa_prefixlen;
+	key.scope = ifa->ifa_scope;
+	key.flags = ifa->ifa_flags;
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		switch (rta->rta_type) {
+		case IFA_LOCAL:
+			local = RTA_DATA(rta);
+			break;
+		case IFA_ADDRESS:
+			address = RTA_DATA(rta);
+			break;
+#ifdef IFA_FLAGS
+		case IFA_FLAGS:
+			key.flags = *(uint32_t *)RTA_DATA(rta);
+			break;
+#endif
+		}
+	}
+	/* IFA_LOCAL is the address itself, IFA_ADDRESS may be the peer */
+	if (local == NULL && (local = address) == NULL) {
+		return;
+	}
+	memcpy(key.addr, local, addr_len(key.family));
+
+	for (pa = &addrs; (a = *pa) != NULL; pa = &a->next) {
+		if (a->family == key.family && a->ifindex == key.ifindex
+		&&	memcmp(a->addr, key.addr, sizeof(a->addr)) == 0) {
+			break;
+		}
+	}
+	if (nh->nlmsg_type == RTM_DELADDR) {
+		if (a) {
+			*pa = a->next;
+			free(a);
+		}
+		return;
+	}
+	if (a == NULL) {
+		if ((a = malloc(sizeof(*a))) == NULL) {
+			return;
+		}
+		*pa = a;
+		key.next = NULL;
+	} else {
+		key.next = a->next;
+	}
+	*a = key;
+}
+
+static void
+handle_msg(struct nlmsghdr *nh)
+{
+	switch (nh->nlmsg_type) {
+	case RTM_NEWLINK:
+	case RTM_DELLINK:
+		handle_link(nh);
+		break;
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		handle_addr(nh);
+		break;
+	}
+	/* whatever changed may change a route lookup too */
+	route_gen++;
+}
+
+/*
+ * rtnetlink
+ */
+static int
+rq_send(struct nlmsghdr *nh)
+{
+	struct sockaddr_nl nladdr;
+
+	nh->nlmsg_seq = ++rq_seq;
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(rq_fd, nh, nh->nlmsg_len, 0
+	,	(struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		return -errno;
+	}
+	return 0;
+}
+
+/* Read replies to our last request; each is passed to cb. */
+static int
+rq_recv(int (*cb)(struct nlmsghdr *, void *), void *arg)
+{
+	static char	buf[65536];
+	struct nlmsghdr	*nh;
+	int	len;
+
+	for (;;) {
+		len = recv(rq_fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -errno;
+		}
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned)len)
+		;	nh = NLMSG_NEXT(nh, len)) {
+			if (nh->nlmsg_seq != rq_seq) {
+				continue;
+			}
+			if (nh->nlmsg_type == NLMSG_DONE) {
+				return 0;
+			}
+			if (nh->nlmsg_type == NLMSG_ERROR) {
+				return ((struct nlmsgerr *)NLMSG_DATA(nh))->error;
+			}
+			if (cb(nh, arg)) {
+				return 0;
+			}
+		}
+	}
+}
+
+static int
+dump_cb(struct nlmsghdr *nh, void *arg)
+{
+	handle_msg(nh);
+	return 0;
+}
+
+static int
+dump(int type)
+{
+	struct {
+		struct nlmsghdr	nh;
+		struct rtgenmsg	g;
+	} req;
+	int rc;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(req.g));
+	req.nh.nlmsg_type = type;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.g.rtgen_family = AF_UNSPEC;
+	if ((rc = rq_send(&req.nh)) < 0) {
+		return rc;
+	}
+	return rq_recv(dump_cb, NULL);
+}
+
+static int
+resync(void)
+{
+	int rc;
+
+	tables_clear();
+	if ((rc = dump(RTM_GETLINK)) < 0 || (rc = dump(RTM_GETADDR)) < 0) {
+		syslog(LOG_ERR, "cannot dump links/addresses: %s", strerror(-rc));
+		return rc;
+	}
+	route_gen++;
+	return 0;
+}
+
+/* Apply all pending events; on overflow start over from a dump. */
+static void
+drain_events(void)
+{
+	static char	buf[65536];
+	struct nlmsghdr	*nh;
+	int	len;
+
+	for (;;) {
+		len = recv(ev_fd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == ENOBUFS) {
+				if (verbose) {
+					syslog(LOG_INFO, "event overrun, resync");
+				}
+				resync();
+				continue;
+			}
+			return;
+		}
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned)len)
+		;	nh = NLMSG_NEXT(nh, len)) {
+			handle_msg(nh);
+		}
+	}
+}
+
+static int
+open_netlink(void)
+{
+	static const int groups[] = {
+		RTNLGRP_LINK,
+		RTNLGRP_IPV4_IFADDR, RTNLGRP_IPV6_IFADDR,
+		RTNLGRP_IPV4_ROUTE, RTNLGRP_IPV6_ROUTE,
+		RTNLGRP_IPV4_RULE, RTNLGRP_IPV6_RULE,
+	};
+	struct sockaddr_nl nladdr;
+	int rcvbuf = 4 << 20;
+	unsigned i;
+
+	ev_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	rq_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (ev_fd < 0 || rq_fd < 0) {
+		return -errno;
+	}
+	if (setsockopt(ev_fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) < 0) {
+		setsockopt(ev_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	}
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (bind(ev_fd, (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		return -errno;
+	}
+	for (i = 0; i < sizeof(groups) / sizeof(groups[0]); i++) {
+		if (setsockopt(ev_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP
+		,	&groups[i], sizeof(groups[i])) < 0) {
+			return -errno;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Queries
+ */
+static int
+route_cb(struct nlmsghdr *nh, void *arg)
+{
+	struct rtcache_resp *resp = arg;
+	struct rtcache_match *m = &resp->match[0];
+	struct rtmsg	*rtm = NLMSG_DATA(nh);
+	struct rtattr	*rta;
+	int	attrlen = RTM_PAYLOAD(nh);
+
+	if (nh->nlmsg_type != RTM_NEWROUTE) {
+		return 0;
+	}
+	if (rtm->rtm_flags & RTM_F_CLONED) {
+		/* no RTM_F_FIB_MATCH here, the client has to do better */
+		resp->status = -EOPNOTSUPP;
+		return 1;
+	}
+	m->plen = rtm->rtm_dst_len;
+	m->rtype = rtm->rtm_type;
+	m->scope = rtm->rtm_scope;
+	for (rta = RTM_RTA(rtm); RTA_OK(rta, attrlen)
+	;	rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == RTA_OIF) {
+			m->ifindex = *(int *)RTA_DATA(rta);
+		} else if (rta->rta_type == RTA_MULTIPATH && !m->ifindex) {
+			struct rtnexthop *nhop = RTA_DATA(rta);
+
+			if (RTA_PAYLOAD(rta) >= sizeof(*nhop)) {
+				m->ifindex = nhop->rtnh_ifindex;
+			}
+		}
+	}
+	link_name(m->ifindex, m->ifname);
+	resp->status = 0;
+	resp->count = 1;
+	return 1;
+}
+
+static void
+query_route(const struct rtcache_req *q, struct rtcache_resp *resp)
+{
+	struct {
+		struct nlmsghdr	nh;
+		struct rtmsg	rtm;
+		char		attrs[64];
+	} req;
+	struct rtattr *rta;
+	struct route_entry *e;
+	unsigned h = 2166136261U, i;
+	int rc, alen = addr_len(q->family);
+
+	/* FNV-1a over what identifies the question */
+	for (i = 0; i < (unsigned)alen; i++) {
+		h = (h ^ q->addr[i]) * 16777619U;
+	}
+	h = (h ^ (unsigned)q->ifindex ^ q->family) * 16777619U;
+	e = &route_cache[h & (ROUTE_CACHE_SIZE - 1)];
+	if (e->gen == route_gen && e->req.family == q->family
+	&&	e->req.ifindex == q->ifindex
+	&&	memcmp(e->req.addr, q->addr, alen) == 0) {
+		*resp = e->resp;
+		return;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg));
+	req.nh.nlmsg_type = RTM_GETROUTE;
+	req.nh.nlmsg_flags = NLM_F_REQUEST;
+	req.rtm.rtm_family = q->family;
+	req.rtm.rtm_dst_len = alen * 8;
+	req.rtm.rtm_flags = RTM_F_FIB_MATCH;
+	rta = (struct rtattr *)req.attrs;
+	rta->rta_type = RTA_DST;
+	rta->rta_len = RTA_LENGTH(alen);
+	memcpy(RTA_DATA(rta), q->addr, alen);
+	req.nh.nlmsg_len += RTA_ALIGN(rta->rta_len);
+	if (q->ifindex) {
+		rta = (struct rtattr *)(req.attrs + RTA_ALIGN(rta->rta_len));
+		rta->rta_type = RTA_OIF;
+		rta->rta_len = RTA_LENGTH(sizeof(int));
+		memcpy(RTA_DATA(rta), &q->ifindex, sizeof(int));
+		req.nh.nlmsg_len += RTA_ALIGN(rta->rta_len);
+	}
+
+	resp->status = -EPROTO;
+	if ((rc = rq_send(&req.nh)) < 0 || (rc = rq_recv(route_cb, resp)) < 0) {
+		resp->status = rc;
+	}
+	if (resp->status == -EOPNOTSUPP || resp->status == -EPROTO) {
+		return;
+	}
+	e->gen = route_gen;
+	e->req = *q;
+	e->resp = *resp;
+}
+
+static int
+prefix_match(const uint8_t *a, const uint8_t *b, int plen)
+{
+	int bytes = plen / 8, bits = plen % 8;
+
+	if (memcmp(a, b, bytes) != 0) {
+		return 0;
+	}
+	return bits == 0
+	||	((a[bytes] ^ b[bytes]) & (0xff << (8 - bits)) & 0xff) == 0;
+}
+
+static void
+query_addr(const struct rtcache_req *q, struct rtcache_resp *resp)
+{
+	struct rtcache_match *m;
+	struct addr *a;
+	int alen = addr_len(q->family);
+
+	for (a = addrs; a && resp->count < RTCACHE_MAX_MATCH; a = a->next) {
+		if (a->family != q->family
+		||	(q->ifindex && a->ifindex != q->ifindex)
+		||	(q->plen && a->plen != q->plen)) {
+			continue;
+		}
+		if (q->type == RTCACHE_ADDR) {
+			if (memcmp(a->addr, q->addr, alen) != 0) {
+				continue;
+			}
+		} else {
+			/* scan_if(): link-local only on a named interface */
+			if (a->scope != RT_SCOPE_UNIVERSE
+			&&	(a->scope != RT_SCOPE_LINK || !q->ifindex)) {
+				continue;
+			}
+			if (!prefix_match(a->addr, q->addr, a->plen)) {
+				continue;
+			}
+		}
+		m = &resp->match[resp->count++];
+		m->ifindex = a->ifindex;
+		m->plen = a->plen;
+		m->scope = a->scope;
+		m->flags = a->flags;
+		link_name(a->ifindex, m->ifname);
+	}
+	resp->status = resp->count ? 0 : -ENOENT;
+}
+
+/* Returns -1 when the client is gone or misbehaves; the caller closes it. */
+static int
+answer(int fd)
+{
+	struct rtcache_req	q;
+	struct rtcache_resp	resp;
+	ssize_t	len;
+
+	len = recv(fd, &q, sizeof(q), 0);
+	if (len != sizeof(q) || q.version != RTCACHE_VERSION
+	||	(q.family != AF_INET && q.family != AF_INET6)) {
+		return -1;
+	}
+
+	/* never answer from a table that is behind the kernel */
+	drain_events();
+
+	memset(&resp, 0, sizeof(resp));
+	resp.netns_dev = netns.st_dev;
+	resp.netns_ino = netns.st_ino;
+	switch (q.type) {
+	case RTCACHE_ROUTE:
+		query_route(&q, &resp);
+		break;
+	case RTCACHE_ADDR:
+	case RTCACHE_ONLINK:
+		query_addr(&q, &resp);
+		break;
+	default:
+		resp.status = -EINVAL;
+	}
+	return send(fd, &resp, sizeof(resp), MSG_NOSIGNAL) == sizeof(resp)
+	?	0 : -1;
+}
+
+static int
+open_listener(void)
+{
+	struct sockaddr_un sun;
+	mode_t	old;
+	int	fd;
+
+	mkdir(HA_RSCTMPDIR, 0755);
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, RTCACHE_SOCKET, sizeof(sun.sun_path) - 1);
+	unlink(RTCACHE_SOCKET);
+	old = umask(077);
+	if (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0
+	||	listen(fd, MAX_CLIENTS) < 0) {
+		umask(old);
+		close(fd);
+		return -1;
+	}
+	umask(old);
+	return fd;
+}
+
+static void
+on_signal(int sig)
+{
+	stop = 1;
+}
+
+static int
+serve(void)
+{
+	struct pollfd	pfd[2 + MAX_CLIENTS];
+	struct sigaction sa;
+	int	nclients = 0, listen_fd, i, fd, rc;
+
+	if (stat(RTCACHE_NETNS, &netns) < 0) {
+		syslog(LOG_WARNING, "cannot stat %s: %s, clients will not"
+		" use the cache", RTCACHE_NETNS, strerror(errno));
+		memset(&netns, 0, sizeof(netns));
+	}
+	if ((rc = open_netlink()) < 0) {
+		syslog(LOG_ERR, "cannot open rtnetlink: %s", strerror(-rc));
+		return 1;
+	}
+	if ((route_cache = calloc(ROUTE_CACHE_SIZE, sizeof(*route_cache))) == NULL
+	||	resync() < 0) {
+		return 1;
+	}
+	if ((listen_fd = open_listener()) < 0) {
+		syslog(LOG_ERR, "cannot listen on %s: %s", RTCACHE_SOCKET
+		,	strerror(errno));
+		return 1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGINT, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	pfd[0].fd = ev_fd;
+	while (!stop) {
+		/* with the table full, leave new clients in the backlog
+		 * (they time out and fall back) instead of spinning on them */
+		pfd[1].fd = nclients < MAX_CLIENTS ? listen_fd : -1;
+		for (i = 0; i < 2 + nclients; i++) {
+			pfd[i].events = POLLIN;
+			pfd[i].revents = 0;
+		}
+		if (poll(pfd, 2 + nclients, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		if (pfd[0].revents) {
+			drain_events();
+		}
+		for (i = 2; i < 2 + nclients; ) {
+			if (pfd[i].revents == 0
+			||	((pfd[i].revents & POLLIN) && answer(pfd[i].fd) == 0)) {
+				i++;
+				continue;
+			}
+			/* gone: move the last client into its slot */
+			close(pfd[i].fd);
+			pfd[i] = pfd[1 + nclients];
+			nclients--;
+		}
+		if (pfd[1].revents & POLLIN) {
+			while (nclients < MAX_CLIENTS
+			&&	(fd = accept4(listen_fd, NULL, NULL
+				,	SOCK_CLOEXEC)) >= 0) {
+				pfd[2 + nclients].fd = fd;
+				nclients++;
+			}
+		}
+	}
+
+	unlink(RTCACHE_SOCKET);
+	return 0;
+}
+
+/*
+ * Client side, for the shell agents
+ */
+static int
+query(int argc, char **argv)
+{
+	struct rtcache_req	req;
+	struct rtcache_resp	resp;
+	const char	*type = argv[0], *nic = NULL;
+	unsigned	i;
+
+	memset(&req, 0, sizeof(req));
+	req.version = RTCACHE_VERSION;
+	if (argc < 2) {
+		return 2;
+	}
+	if (strcmp(type, "route") == 0) {
+		req.type = RTCACHE_ROUTE;
+		nic = argc > 2 ? argv[2] : NULL;
+	} else if (strcmp(type, "addr") == 0 || strcmp(type, "onlink") == 0) {
+		req.type = *type == 'a' ? RTCACHE_ADDR : RTCACHE_ONLINK;
+		req.plen = argc > 2 ? atoi(argv[2]) : 0;
+		nic = argc > 3 ? argv[3] : NULL;
+	} else {
+		return 2;
+	}
+	if (inet_pton(AF_INET, argv[1], req.addr) == 1) {
+		req.family = AF_INET;
+	} else if (inet_pton(AF_INET6, argv[1], req.addr) == 1) {
+		req.family = AF_INET6;
+	} else {
+		return 2;
+	}
+	if (nic && *nic && (req.ifindex = if_nametoindex(nic)) == 0) {
+		return 1;
+	}
+
+	if (rtcache_query(&req, &resp) < 0) {
+		return 3;
+	}
+	if (resp.status < 0) {
+		return 1;
+	}
+	for (i = 0; i < resp.count; i++) {
+		printf("%s %d\n", resp.match[i].ifname, resp.match[i].plen);
+	}
+	return 0;
+}
+
+static void
+usage(const char *cmd)
+{
+	fprintf(stderr, "usage: %s [-f] [-v]\n"
+		"       %s -q route ADDR [nic]\n"
+		"       %s -q addr|onlink ADDR [plen [nic]]\n"
+		"  -f: stay in the foreground, log to stderr too\n"
+		"  -v: log table resyncs\n"
+		"  -q: ask a running rtcached; exit 0 found, 1 not found,"
+		" 3 not running\n", cmd, cmd, cmd);
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	int	c, foreground = 0, q = 0;
+
+	while ((c = getopt(argc, argv, "fvqh")) != EOF) {
+		switch (c) {
+		case 'f':
+			foreground = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'q':
+			q = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (q) {
+		if ((c = query(argc - optind, argv + optind)) == 2) {
+			usage(argv[0]);
+		}
+		return c;
+	}
+	if (optind != argc) {
+		usage(argv[0]);
+	}
+
+	openlog("rtcached", LOG_PID | (foreground ? LOG_PERROR : 0), LOG_DAEMON);
+	if (!foreground && daemon(0, 0) < 0) {
+		syslog(LOG_ERR, "daemon: %s", strerror(errno));
+		return 1;
+	}
+	return serve();
+}
@@ -55,7 +55,7 @@
 #ifdef HAVE_LIBNET_1_1_API
 #	define	LTYPE	libnet_t
 	static libnet_t *mk_packet(libnet_t* lntag, u_int32_t ip, u_char *device, u_char macaddr[6], u_char *broadcast, u_char *netmask, u_short arptype);
-	int send_arp(libnet_t* lntag);
+	int send_arp(libnet_t* lntag, u_int8_t *pkt, u_int32_t len);
 #endif
 
 #define PIDDIR       HA_VARRUNDIR "/" PACKAGE
@@ -149,6 +149,8 @@ main(int argc, char *argv[])
 	u_char *request, *reply;
 #elif defined(HAVE_LIBNET_1_1_API)
 	LTYPE *request, *reply;
+	u_int8_t *request_pkt, *reply_pkt;
+	u_int32_t request_len, reply_len;
 #endif
 
 	memset(&act, 0, sizeof(struct sigaction));
@@ -276,12 +278,13 @@ main(int argc, char *argv[])
 		}
 	}
 #elif defined(HAVE_LIBNET_1_1_API)
-	if ((request=libnet_init(LIBNET_LINK, device, errbuf)) == NULL) {
+	/* "advanced" mode, to assemble each frame once: see below */
+	if ((request=libnet_init(LIBNET_LINK_ADV, device, errbuf)) == NULL) {
 		cl_log(LOG_ERR, "libnet_init failure on %s: %s", device, errbuf);
 		unlink(pidfilename);
 		return EXIT_FAILURE;
 	}
-	if ((reply=libnet_init(LIBNET_LINK, device, errbuf)) == NULL) {
+	if ((reply=libnet_init(LIBNET_LINK_ADV, device, errbuf)) == NULL) {
 		cl_log(LOG_ERR, "libnet_init failure on %s: %s", device, errbuf);
 		unlink(pidfilename);
 		return EXIT_FAILURE;
@@ -302,13 +305,25 @@ main(int argc, char *argv[])
 		unlink(pidfilename);
 		return EXIT_FAILURE;
 	}
+	/*
+	 * libnet_write() would assemble the frame from its pieces again
+	 * for every send; the frames never change, so do it once here and
+	 * send the same bytes each time.
+	 */
+	if (libnet_adv_cull_packet(request, &request_pkt, &request_len) == -1
+	||  libnet_adv_cull_packet(reply, &reply_pkt, &reply_len) == -1) {
+		cl_log(LOG_ERR, "could not assemble packets: %s"
+		,	libnet_geterror(request));
+		unlink(pidfilename);
+		return EXIT_FAILURE;
+	}
 	for (j=0; j < repeatcount; ++j) {
-		c = send_arp(request);
+		c = send_arp(request, request_pkt, request_len);
 		if (c < 0) {
 			break;
 		}
 		mssleep(msinterval / 2);
-		c = send_arp(reply);
+		c = send_arp(reply, reply_pkt, reply_len);
 		if (c < 0) {
 			break;
 		}
@@ -578,13 +593,13 @@ send_arp(struct libnet_link_int *l, u_char *device, u_char *buf)
 
 #ifdef HAVE_LIBNET_1_1_API
 int
-send_arp(libnet_t* lntag)
+send_arp(libnet_t* lntag, u_int8_t *pkt, u_int32_t len)
 {
 	int n;
 
-	n = libnet_write(lntag);
+	n = libnet_adv_write_link(lntag, pkt, len);
 	if (n == -1) {
-		cl_log(LOG_ERR, "libnet_write failed");
+		cl_log(LOG_ERR, "libnet_adv_write_link failed");
 	}
 	return (n);
 }
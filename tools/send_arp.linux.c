@@ -35,9 +35,17 @@
 #include <sys/signal.h>
 #include <signal.h>
 #include <sys/ioctl.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <stdint.h>
+#include <time.h>
 #include <net/if.h>
 #include <linux/if_packet.h>
 #include <linux/if_ether.h>
+#include <linux/netlink.h>
+#include <linux/filter.h>
+#include <linux/rtnetlink.h>
 #include <net/if_arp.h>
 #include <sys/uio.h>
 #ifdef CAPABILITIES
@@ -53,6 +61,7 @@
 #include <string.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <announce_sched.h>
 
 #ifdef USE_SYSFS
 #include <sysfs/libsysfs.h>
@@ -71,6 +80,7 @@ struct sysfs_devattr_values;
 static char SNAPSHOT[] = "s20121221";
 
 static void usage(void) __attribute__((noreturn));
+static int kernel_announce(void);
 
 #ifndef DEFAULT_DEVICE
 #define DEFAULT_DEVICE "eth0"
@@ -81,9 +91,16 @@ static void usage(void) __attribute__((noreturn));
 # define DEFAULT_DEVICE		NULL
 #endif
 
+#define DEVICE_ADDR_MAX	32
+
 struct device {
 	const char *name;
 	int ifindex;
+	/* from find_device_by_netlink() */
+	size_t brd_len;
+	unsigned char brd[DEVICE_ADDR_MAX];
+	size_t addr_len;
+	unsigned char addr[DEVICE_ADDR_MAX];
 #ifndef WITHOUT_IFADDRS
 	struct ifaddrs *ifa;
 #endif
@@ -115,6 +132,17 @@ struct timeval start, last;
 int sent, brd_sent;
 int received, brd_recv, req_recv;
 
+/* -S: send on this schedule rather than once a second */
+static struct announce_sched sched;
+static int use_sched, sched_next;
+
+/* -K: have the kernel send the first announcement (kernel_announce()) */
+static int kernel_notify;
+
+/* tick() runs off this timer, due at next_tick (CLOCK_MONOTONIC) */
+static int timer_fd = -1;
+static struct timespec next_tick;
+
 #ifndef CAPABILITIES
 static uid_t euid;
 #endif
@@ -138,6 +166,7 @@ static socklen_t sll_len(size_t halen)
 static char print_usage[]={
 "send_arp: sends out custom ARP packet.\n"
 "  usage: send_arp [-i repeatinterval-ms] [-r repeatcount] [-p pidfile] \\\n"
+"              [-S schedule [-J jitter]] [-K] \\\n"
 "              device src_ip_addr src_hw_addr broadcast_ip_addr netmask\n"
 "\n"
 "  where:\n"
@@ -145,6 +174,18 @@ static char print_usage[]={
 "\n"
 "    repeatcount: how many ARP packets to send.\n"
 "\n"
+"    schedule: ms to wait before each packet, e.g. 0,50,200,1000,5000\n"
+"              (the last one repeats); without it, one per second.\n"
+"\n"
+"    jitter: vary each wait randomly by up to this many percent.\n"
+"\n"
+"    -K: have the kernel send the first ARP, for every address on the\n"
+"        device, by setting the device's MAC address to itself; the\n"
+"        repeats are sent as without -K. Needs arp_notify and\n"
+"        CAP_NET_ADMIN, else all ARPs are sent as without -K.\n"
+"        Side effects: the device's neighbour entries and the route\n"
+"        cache are flushed, and its addr_assign_type becomes 3 (set).\n"
+"\n"
 "    pidfile: pid file to use\n"
 "\n"
 "    device: network interface to use\n"
@@ -196,16 +237,6 @@ void usage(void)
 }
 #endif /* hb_mode */
 
-static void set_signal(int signo, void (*handler)(void))
-{
-	struct sigaction sa;
-
-	memset(&sa, 0, sizeof(sa));
-	sa.sa_handler = (void (*)(int))handler;
-	sa.sa_flags = SA_RESTART;
-	sigaction(signo, &sa, NULL);
-}
-
 #ifdef CAPABILITIES
 static const cap_value_t caps[] = { CAP_NET_RAW, };
 static cap_flag_value_t cap_raw = CAP_CLEAR;
@@ -325,12 +356,19 @@ static void drop_capabilities(void)
 #endif
 }
 
-static int send_pack(int s, struct in_addr src, struct in_addr dst,
-	      struct sockaddr_ll *ME, struct sockaddr_ll *HE)
+/*
+ * The frame send_pack() sends, built on first use.  It only changes
+ * when HE does (recv_pack() going unicast), which clears pack_len.
+ */
+static union {
+	struct arphdr	ah;
+	unsigned char	buf[256];
+} pack;
+static int pack_len;
+
+static int build_pack(unsigned char *buf, struct in_addr src, struct in_addr dst,
+		      struct sockaddr_ll *ME, struct sockaddr_ll *HE)
 {
-	int err;
-	struct timeval now;
-	unsigned char buf[256];
 	struct arphdr *ah = (struct arphdr*)buf;
 	unsigned char *p = (unsigned char *)(ah+1);
 
@@ -357,10 +395,22 @@ static int send_pack(int s, struct in_addr src, struct in_addr dst,
 	memcpy(p, &dst, 4);
 	p+=4;
 
-	gettimeofday(&now, NULL);
-	err = sendto(s, buf, p-buf, 0, (struct sockaddr*)HE, SLL_LEN(ah->ar_hln));
-	if (err == p-buf) {
-		last = now;
+	return p-buf;
+}
+
+/* send the frame; now is when, for the round trip times */
+static int send_pack(int s, struct in_addr src, struct in_addr dst,
+		     struct sockaddr_ll *ME, struct sockaddr_ll *HE,
+		     const struct timeval *now)
+{
+	int err;
+
+	if (!pack_len)
+		pack_len = build_pack(pack.buf, src, dst, ME, HE);
+
+	err = sendto(s, pack.buf, pack_len, 0, (struct sockaddr*)HE, SLL_LEN(pack.ah.ar_hln));
+	if (err == pack_len) {
+		last = *now;
 		sent++;
 		if (!unicasting)
 			brd_sent++;
@@ -394,7 +444,57 @@ static void finish(void)
 	exit(!received);
 }
 
-static void catcher(void)
+/*
+ * Have tick() run delay ms after the previous one was due.  The timer
+ * is absolute, so the time spent sending and receiving does not add up.
+ */
+static void tick_arm(int delay)
+{
+	struct itimerspec its;
+
+	next_tick.tv_sec += delay / 1000;
+	next_tick.tv_nsec += (delay % 1000) * 1000000L;
+	if (next_tick.tv_nsec >= 1000000000L) {
+		next_tick.tv_sec++;
+		next_tick.tv_nsec -= 1000000000L;
+	}
+	memset(&its, 0, sizeof(its));
+	its.it_value = next_tick;
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+		perror("arping: timerfd_settime");
+		exit(2);
+	}
+}
+
+/*
+ * Announce once.  With -K the first one goes through the kernel, if it
+ * will, and the repeats are sent as packets: every kernel announcement
+ * flushes the device's neighbours and announces all its addresses.
+ */
+static void announce(const struct timeval *now)
+{
+	if (kernel_notify) {
+		kernel_notify = 0;
+		if (kernel_announce() == 0) {
+			last = *now;
+			sent++;
+			brd_sent++;
+			return;
+		}
+		if (s < 0) {
+			fprintf(stderr, "arping: the kernel does not announce %s and there is no packet socket\n",
+				device.name);
+			exit(2);
+		}
+		if (!quiet)
+			fprintf(stderr, "WARNING: the kernel does not announce %s, sending ARPs instead.\n",
+				device.name);
+	}
+	send_pack(s, src, dst,
+		  (struct sockaddr_ll *)&me, (struct sockaddr_ll *)&he, now);
+}
+
+static void tick(void)
 {
 	struct timeval tv, tv_s, tv_o;
 
@@ -410,16 +510,23 @@ static void catcher(void)
 	if (count-- == 0 || (timeout && timercmp(&tv_s, &tv_o, >)))
 		finish();
 
+	if (use_sched) {
+		announce(&tv);
+		if (count == 0 && unsolicited)
+			finish();
+		tick_arm(announce_sched_delay(&sched, sched_next++));
+		return;
+	}
+
 	timersub(&tv, &last, &tv_s);
 	tv_o.tv_sec = 0;
 
 	if (last.tv_sec==0 || timercmp(&tv_s, &tv_o, >)) {
-		send_pack(s, src, dst,
-			  (struct sockaddr_ll *)&me, (struct sockaddr_ll *)&he);
+		announce(&tv);
 		if (count == 0 && unsolicited)
 			finish();
 	}
-	alarm(1);
+	tick_arm(1000);
 }
 
 static void print_hex(unsigned char *p, int len)
@@ -535,6 +642,7 @@ static int recv_pack(unsigned char *buf, int len, struct sockaddr_ll *FROM)
 	if(!broadcast_only) {
 		memcpy(((struct sockaddr_ll *)&he)->sll_addr, p, ((struct sockaddr_ll *)&me)->sll_halen);
 		unicasting=1;
+		pack_len = 0;
 	}
 	return 1;
 }
@@ -628,6 +736,9 @@ static void byebye(int nsig)
  * "device" variable for later reference.
  *
  * We have several implementations for this.
+ *	by_netlink():	asks rtnetlink for the named device only, so it
+ *			costs the same however many devices the host has.
+ *			Needs a device name.
  *	by_ifaddrs():	requires getifaddr() in glibc, and rtnetlink in
  *			kernel. default and recommended for recent systems.
  *	by_sysfs():	requires libsysfs , and sysfs in kernel.
@@ -657,6 +768,180 @@ static int check_ifflags(unsigned int ifflags, int fatal)
 	return 0;
 }
 
+/* a link request: header, ifinfomsg and room for a few attributes */
+struct link_req {
+	struct nlmsghdr		nh;
+	struct ifinfomsg	ifi;
+	char			attrbuf[64];
+};
+
+static void link_req_init(struct link_req *req, int type, int flags)
+{
+	memset(req, 0, sizeof(*req));
+	req->nh.nlmsg_len = NLMSG_LENGTH(sizeof(req->ifi));
+	req->nh.nlmsg_type = type;
+	req->nh.nlmsg_flags = NLM_F_REQUEST | flags;
+	req->ifi.ifi_family = AF_UNSPEC;
+}
+
+static void link_req_attr(struct link_req *req, int type, const void *data, size_t len)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *)((char *)req + NLMSG_ALIGN(req->nh.nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	req->nh.nlmsg_len = NLMSG_ALIGN(req->nh.nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/*
+ * Send req over rtnetlink and read the one reply into buf.
+ * Returns the reply's length, or -1.
+ */
+static int link_req_talk(struct link_req *req, char *buf, size_t buflen)
+{
+	int fd, len;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0)
+		return -1;
+	if (send(fd, req, req->nh.nlmsg_len, 0) < 0) {
+		close(fd);
+		return -1;
+	}
+	len = recv(fd, buf, buflen, 0);
+	close(fd);
+	if (len < 0 || !NLMSG_OK((struct nlmsghdr *)buf, len))
+		return -1;
+	return len;
+}
+
+static int find_device_by_netlink(void)
+{
+	struct link_req req;
+	struct rtattr *rta;
+	struct nlmsghdr *nh;
+	struct ifinfomsg *ifi;
+	unsigned char *addr = NULL, *brd = NULL;
+	size_t addr_len = 0, brd_len = 0;
+	uint32_t ext_mask = RTEXT_FILTER_SKIP_STATS;
+	char buf[16384];
+	int attrlen;
+
+	if (!device.name)
+		return -1;
+	if (strlen(device.name) >= IFNAMSIZ)
+		return 1;
+
+	link_req_init(&req, RTM_GETLINK, 0);
+	link_req_attr(&req, IFLA_IFNAME, device.name, strlen(device.name) + 1);
+	/* the counters are most of a link message and are not needed */
+	link_req_attr(&req, IFLA_EXT_MASK, &ext_mask, sizeof(ext_mask));
+
+	if (link_req_talk(&req, buf, sizeof(buf)) < 0)
+		return -1;
+
+	nh = (struct nlmsghdr *)buf;
+	if (nh->nlmsg_type == NLMSG_ERROR) {
+		struct nlmsgerr *err = NLMSG_DATA(nh);
+		/* no such device; anything else, let the others try */
+		return err->error == -ENODEV ? 1 : -1;
+	}
+	if (nh->nlmsg_type != RTM_NEWLINK)
+		return -1;
+
+	ifi = NLMSG_DATA(nh);
+	attrlen = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+		if (rta->rta_type == IFLA_ADDRESS) {
+			addr = RTA_DATA(rta);
+			addr_len = RTA_PAYLOAD(rta);
+		} else if (rta->rta_type == IFLA_BROADCAST) {
+			brd = RTA_DATA(rta);
+			brd_len = RTA_PAYLOAD(rta);
+		}
+	}
+
+	check_ifflags(ifi->ifi_flags, 1);
+	if (!addr || !addr_len || !brd)
+		return 1;
+
+	device.ifindex = ifi->ifi_index;
+	if (brd_len <= sizeof(device.brd)) {
+		memcpy(device.brd, brd, brd_len);
+		device.brd_len = brd_len;
+	}
+	if (addr_len <= sizeof(device.addr)) {
+		memcpy(device.addr, addr, addr_len);
+		device.addr_len = addr_len;
+	}
+	return 0;
+}
+
+/* arp_notify is in effect if it is set for "all" or for the device */
+static int arp_notify_enabled(const char *name)
+{
+	const char *conf[2];
+	char path[128];
+	FILE *f;
+	int i, val, on = 0;
+
+	conf[0] = "all";
+	conf[1] = name;
+	for (i = 0; i < 2; i++) {
+		snprintf(path, sizeof(path), "/proc/sys/net/ipv4/conf/%s/arp_notify", conf[i]);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fscanf(f, "%d", &val) == 1 && val > 0)
+			on = 1;
+		fclose(f);
+	}
+	return on;
+}
+
+/*
+ * kernel_announce()
+ *
+ * Have the kernel send a gratuitous ARP for every address on the
+ * device.  Setting the link address, even to the one it already has,
+ * raises NETDEV_CHANGEADDR, which the kernel answers with those ARPs
+ * when arp_notify is on.  This needs CAP_NET_ADMIN but no packet
+ * socket, and nothing is built or sent here.
+ *
+ * It is not free: NETDEV_CHANGEADDR also flushes the device's neighbour
+ * entries and the route cache, and the device's addr_assign_type
+ * becomes NET_ADDR_SET ("set by userspace").  So it is done once per
+ * run, never per repeat.
+ *
+ * Return value:
+ *	0	: the kernel took it.
+ *	<0	: it will not (no arp_notify, no permission, or a device
+ *		  whose address cannot be set); send the packets ourselves.
+ */
+static int kernel_announce(void)
+{
+	struct link_req req;
+	struct nlmsghdr *nh;
+	char buf[1024];
+
+	if (!device.addr_len || !arp_notify_enabled(device.name))
+		return -1;
+
+	link_req_init(&req, RTM_SETLINK, NLM_F_ACK);
+	req.ifi.ifi_index = device.ifindex;
+	link_req_attr(&req, IFLA_ADDRESS, device.addr, device.addr_len);
+
+	if (link_req_talk(&req, buf, sizeof(buf)) < 0)
+		return -1;
+	nh = (struct nlmsghdr *)buf;
+	if (nh->nlmsg_type != NLMSG_ERROR ||
+	    ((struct nlmsgerr *)NLMSG_DATA(nh))->error != 0)
+		return -1;
+	return 0;
+}
+
 static int find_device_by_ifaddrs(void)
 {
 #ifndef WITHOUT_IFADDRS
@@ -978,6 +1263,9 @@ out:
 static int find_device(void)
 {
 	int rc;
+	rc = find_device_by_netlink();
+	if (rc >= 0)
+		goto out;
 	rc = find_device_by_ifaddrs();
 	if (rc >= 0)
 		goto out;
@@ -995,6 +1283,16 @@ out:
  * This fills the device "broadcast address"
  * based on information found by find_device() funcion.
  */
+static int set_device_broadcast_netlink(struct device *device, unsigned char *ba, size_t balen)
+{
+	if (!device || !device->brd_len)
+		return -1;
+	if (device->brd_len != balen)
+		return -1;
+	memcpy(ba, device->brd, balen);
+	return 0;
+}
+
 static int set_device_broadcast_ifaddrs_one(struct device *device, unsigned char *ba, size_t balen, int fatal)
 {
 #ifndef WITHOUT_IFADDRS
@@ -1052,6 +1350,8 @@ static int set_device_broadcast_fallback(struct device *device, unsigned char *b
 
 static void set_device_broadcast(struct device *dev, unsigned char *ba, size_t balen)
 {
+	if (!set_device_broadcast_netlink(dev, ba, balen))
+		return;
 	if (!set_device_broadcast_ifaddrs_one(dev, ba, balen, 0))
 		return;
 	if (!set_device_broadcast_sysfs(dev, ba, balen))
@@ -1059,12 +1359,106 @@ static void set_device_broadcast(struct device *dev, unsigned char *ba, size_t b
 	set_device_broadcast_fallback(dev, ba, balen);
 }
 
+static void bpf_insn(struct sock_filter *f, __u16 code, __u32 k, __u8 jt, __u8 jf)
+{
+	f->code = code;
+	f->jt = jt;
+	f->jf = jf;
+	f->k = k;
+}
+
+/*
+ * install_filter()
+ *
+ * Let the kernel drop what recv_pack() would ignore anyway, so that
+ * ARP chatter on a busy segment does not wake us for every frame: only
+ * IPv4 ARP requests and replies coming in, with our link address length,
+ * from the target address and, unless probing from 0.0.0.0, to our
+ * source address.  recv_pack() still checks everything; if the filter
+ * cannot be attached we just see more.
+ */
+static void install_filter(int halen)
+{
+	struct sock_filter f[32], *p = f;
+	struct sock_fprog prog;
+
+	/* the socket is SOCK_DGRAM: offsets are into the ARP header */
+	bpf_insn(p++, BPF_LD | BPF_B | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE, 0, 0);
+	bpf_insn(p++, BPF_JMP | BPF_JGT | BPF_K, PACKET_MULTICAST, 0, 1);
+	bpf_insn(p++, BPF_RET | BPF_K, 0, 0, 0);
+	bpf_insn(p++, BPF_LD | BPF_H | BPF_ABS, 6, 0, 0);
+	bpf_insn(p++, BPF_JMP | BPF_JEQ | BPF_K, ARPOP_REQUEST, 2, 0);
+	bpf_insn(p++, BPF_JMP | BPF_JEQ | BPF_K, ARPOP_REPLY, 1, 0);
+	bpf_insn(p++, BPF_RET | BPF_K, 0, 0, 0);
+	bpf_insn(p++, BPF_LD | BPF_H | BPF_ABS, 2, 0, 0);
+	bpf_insn(p++, BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 1, 0);
+	bpf_insn(p++, BPF_RET | BPF_K, 0, 0, 0);
+	bpf_insn(p++, BPF_LD | BPF_B | BPF_ABS, 4, 0, 0);
+	bpf_insn(p++, BPF_JMP | BPF_JEQ | BPF_K, halen, 1, 0);
+	bpf_insn(p++, BPF_RET | BPF_K, 0, 0, 0);
+	bpf_insn(p++, BPF_LD | BPF_B | BPF_ABS, 5, 0, 0);
+	bpf_insn(p++, BPF_JMP | BPF_JEQ | BPF_K, 4, 1, 0);
+	bpf_insn(p++, BPF_RET | BPF_K, 0, 0, 0);
+	/* sender protocol address */
+	bpf_insn(p++, BPF_LD | BPF_W | BPF_ABS, sizeof(struct arphdr) + halen, 0, 0);
+	bpf_insn(p++, BPF_JMP | BPF_JEQ | BPF_K, ntohl(dst.s_addr), 1, 0);
+	bpf_insn(p++, BPF_RET | BPF_K, 0, 0, 0);
+	/* target protocol address */
+	if (!dad || src.s_addr) {
+		bpf_insn(p++, BPF_LD | BPF_W | BPF_ABS, sizeof(struct arphdr) + 2 * halen + 4, 0, 0);
+		bpf_insn(p++, BPF_JMP | BPF_JEQ | BPF_K, ntohl(src.s_addr), 1, 0);
+		bpf_insn(p++, BPF_RET | BPF_K, 0, 0, 0);
+	}
+	bpf_insn(p++, BPF_RET | BPF_K, 0xffff, 0, 0);
+
+	prog.len = p - f;
+	prog.filter = f;
+	if (setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) < 0 && !quiet)
+		perror("WARNING: setsockopt(SO_ATTACH_FILTER)");
+}
+
+/* bind the packet socket to the device and set up me and he */
+static void packet_setup(void)
+{
+	((struct sockaddr_ll *)&me)->sll_family = AF_PACKET;
+	((struct sockaddr_ll *)&me)->sll_ifindex = device.ifindex;
+	((struct sockaddr_ll *)&me)->sll_protocol = htons(ETH_P_ARP);
+	if (bind(s, (struct sockaddr*)&me, sizeof(me)) == -1) {
+		perror("bind");
+		exit(2);
+	}
+
+	if (1) {
+		socklen_t alen = sizeof(me);
+		if (getsockname(s, (struct sockaddr*)&me, &alen) == -1) {
+			perror("getsockname");
+			exit(2);
+		}
+	}
+	if (((struct sockaddr_ll *)&me)->sll_halen == 0) {
+		if (!quiet)
+			printf("Interface \"%s\" is not ARPable (no ll address)\n", device.name);
+		exit(dad?0:2);
+	}
+
+	install_filter(((struct sockaddr_ll *)&me)->sll_halen);
+
+	he = me;
+
+	set_device_broadcast(&device, ((struct sockaddr_ll *)&he)->sll_addr,
+			     ((struct sockaddr_ll *)&he)->sll_halen);
+}
+
 int
 main(int argc, char **argv)
 {
 	int socket_errno;
 	int ch;
 	int hb_mode = 0;
+	char *sched_spec = NULL;
+	int jitter = 0;
+	sigset_t sset;
+	int sig_fd;
 
 	signal(SIGTERM, byebye);
 	signal(SIGPIPE, byebye);
@@ -1082,7 +1476,7 @@ main(int argc, char **argv)
 
 	disable_capability_raw();
 
-	while ((ch = getopt(argc, argv, "h?bfDUAqc:w:s:I:Vr:i:p:")) != EOF) {
+	while ((ch = getopt(argc, argv, "h?bfDUAqc:w:s:I:Vr:i:p:S:J:K")) != EOF) {
 		switch(ch) {
 		case 'b':
 			broadcast_only=1;
@@ -1122,6 +1516,15 @@ main(int argc, char **argv)
 		case 'V':
 			printf("send_arp utility, based on arping from iputils-%s\n", SNAPSHOT);
 			exit(0);
+		case 'S':
+			sched_spec = optarg;
+			break;
+		case 'J':
+			jitter = atoi(optarg);
+			break;
+		case 'K':
+			kernel_notify = 1;
+			break;
 		case 'p':
 		case 'i':
 		    hb_mode = 1;
@@ -1134,6 +1537,15 @@ main(int argc, char **argv)
 		}
 	}
 
+	if (sched_spec) {
+		if (announce_sched_parse(&sched, sched_spec, jitter) < 0) {
+			fprintf(stderr, "send_arp: invalid schedule %s (jitter %d)\n",
+				sched_spec, jitter);
+			usage();
+		}
+		use_sched = 1;
+	}
+
 	if(hb_mode) {
 	    /* send_arp.libnet compatibility mode */
 	    if (argc - optind != 5) {
@@ -1169,7 +1581,18 @@ main(int argc, char **argv)
 	if (device.name && !*device.name)
 		device.name = NULL;
 
-	if (s < 0) {
+	if (kernel_notify && (!unsolicited || advert || dad)) {
+		fprintf(stderr, "send_arp: -K is for unsolicited ARPs (-U) only\n");
+		usage();
+	}
+
+	/* -K can do without the packet socket for its one announcement */
+	if (kernel_notify && s < 0 && count != 1) {
+		errno = socket_errno;
+		perror("arping: -K with repeats needs a packet socket");
+		exit(2);
+	}
+	if (s < 0 && !kernel_notify) {
 		errno = socket_errno;
 		perror("arping: socket");
 		exit(2);
@@ -1268,31 +1691,8 @@ main(int argc, char **argv)
 		close(probe_fd);
 	};
 
-	((struct sockaddr_ll *)&me)->sll_family = AF_PACKET;
-	((struct sockaddr_ll *)&me)->sll_ifindex = device.ifindex;
-	((struct sockaddr_ll *)&me)->sll_protocol = htons(ETH_P_ARP);
-	if (bind(s, (struct sockaddr*)&me, sizeof(me)) == -1) {
-		perror("bind");
-		exit(2);
-	}
-
-	if (1) {
-		socklen_t alen = sizeof(me);
-		if (getsockname(s, (struct sockaddr*)&me, &alen) == -1) {
-			perror("getsockname");
-			exit(2);
-		}
-	}
-	if (((struct sockaddr_ll *)&me)->sll_halen == 0) {
-		if (!quiet)
-			printf("Interface \"%s\" is not ARPable (no ll address)\n", device.name);
-		exit(dad?0:2);
-	}
-
-	he = me;
-
-	set_device_broadcast(&device, ((struct sockaddr_ll *)&he)->sll_addr,
-			     ((struct sockaddr_ll *)&he)->sll_halen);
+	if (s >= 0)
+		packet_setup();
 
 	if (!quiet) {
 		printf("ARPING %s ", inet_ntoa(dst));
@@ -1306,30 +1706,65 @@ main(int argc, char **argv)
 
 	drop_capabilities();
 
-	set_signal(SIGINT, finish);
-	set_signal(SIGALRM, catcher);
+	/*
+	 * Sending, replies and SIGINT are all handled in the loop below,
+	 * one at a time: the timer says when tick() is due and SIGINT is
+	 * read from a signalfd rather than caught.
+	 */
+	sigemptyset(&sset);
+	sigaddset(&sset, SIGINT);
+	sigprocmask(SIG_BLOCK, &sset, NULL);
+	sig_fd = signalfd(-1, &sset, SFD_CLOEXEC);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (sig_fd < 0 || timer_fd < 0) {
+		perror("arping: timerfd/signalfd");
+		exit(2);
+	}
 
-	catcher();
+	clock_gettime(CLOCK_MONOTONIC, &next_tick);
+	if (use_sched)
+		tick_arm(announce_sched_delay(&sched, sched_next++));
+	else
+		tick();
 
 	while(1) {
-		sigset_t sset, osset;
-		unsigned char packet[4096];
-		struct sockaddr_storage from;
-		socklen_t alen = sizeof(from);
-		int cc;
-
-		if ((cc = recvfrom(s, packet, sizeof(packet), 0,
-				   (struct sockaddr *)&from, &alen)) < 0) {
-			perror("arping: recvfrom");
-			continue;
+		struct pollfd pfd[3];
+
+		pfd[0].fd = s;
+		pfd[1].fd = timer_fd;
+		pfd[2].fd = sig_fd;
+		pfd[0].events = pfd[1].events = pfd[2].events = POLLIN;
+		if (poll(pfd, 3, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("arping: poll");
+			exit(2);
 		}
 
-		sigemptyset(&sset);
-		sigaddset(&sset, SIGALRM);
-		sigaddset(&sset, SIGINT);
-		sigprocmask(SIG_BLOCK, &sset, &osset);
-		recv_pack(packet, cc, (struct sockaddr_ll *)&from);
-		sigprocmask(SIG_SETMASK, &osset, NULL);
+		if (pfd[2].revents)
+			finish();
+
+		if (pfd[1].revents) {
+			uint64_t expired;
+
+			if (read(timer_fd, &expired, sizeof(expired)) == sizeof(expired))
+				tick();
+		}
+
+		if (pfd[0].revents) {
+			unsigned char packet[4096];
+			struct sockaddr_storage from;
+			socklen_t alen = sizeof(from);
+			int cc;
+
+			if ((cc = recvfrom(s, packet, sizeof(packet), MSG_DONTWAIT,
+					   (struct sockaddr *)&from, &alen)) < 0) {
+				if (errno != EAGAIN && errno != EINTR)
+					perror("arping: recvfrom");
+				continue;
+			}
+			recv_pack(packet, cc, (struct sockaddr_ll *)&from);
+		}
 	}
 }
 
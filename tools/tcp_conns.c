@@ -0,0 +1,276 @@
+/* 
+   List TCP connections of a local address
+
+   Prints one "local_ip:port<TAB>remote_ip:port" line per connection,
+   the format tickle_tcp reads.  Filtering by address and port is done
+   in the kernel (inet_diag bytecode), so the cost does not depend on
+   the number of other sockets on the host.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "tcp_diag.h"
+
+#define MAX_RANGES	64
+
+struct conns_out {
+	FILE *f;
+	int quiet;
+	unsigned long count;
+};
+
+static int parse_ports(const char *s, struct tcp_port_range *r, int max);
+static const char *diag_addr(int family, const uint32_t *addr, char *buf, size_t len);
+static int print_conn(const struct inet_diag_msg *msg, void *arg);
+static void drop_outfile(const char *outfile, const char *tmpfile);
+static void usage(void);
+
+/* portblock syntax: "80,443,1000:2000" */
+static int parse_ports(const char *s, struct tcp_port_range *r, int max)
+{
+	char *endp;
+	unsigned long lo, hi;
+	int n = 0;
+
+	while (*s) {
+		if (n == max)
+			return -1;
+		lo = strtoul(s, &endp, 10);
+		if (endp == s || lo > 65535)
+			return -1;
+		hi = lo;
+		s = endp;
+		if (*s == ':') {
+			hi = strtoul(++s, &endp, 10);
+			if (endp == s || hi > 65535 || hi < lo)
+				return -1;
+			s = endp;
+		}
+		r[n].lo = lo;
+		r[n].hi = hi;
+		n++;
+		if (*s == ',')
+			s++;
+		else if (*s)
+			return -1;
+	}
+	return n;
+}
+
+static const char *diag_addr(int family, const uint32_t *addr, char *buf, size_t len)
+{
+	/* show v4-mapped addresses of AF_INET6 sockets as plain IPv4 */
+	if (family == AF_INET6 && addr[0] == 0 && addr[1] == 0
+	&&  addr[2] == htonl(0xffff))
+		return inet_ntop(AF_INET, &addr[3], buf, len);
+	return inet_ntop(family, addr, buf, len);
+}
+
+static int print_conn(const struct inet_diag_msg *msg, void *arg)
+{
+	struct conns_out *out = arg;
+	char local[INET6_ADDRSTRLEN], remote[INET6_ADDRSTRLEN];
+
+	out->count++;
+	if (out->quiet)
+		return 1;
+
+	fprintf(out->f, "%s:%u\t%s:%u\n",
+		diag_addr(msg->idiag_family, msg->id.idiag_src, local, sizeof(local)),
+		ntohs(msg->id.idiag_sport),
+		diag_addr(msg->idiag_family, msg->id.idiag_dst, remote, sizeof(remote)),
+		ntohs(msg->id.idiag_dport));
+	return 0;
+}
+
+/*
+ * The list could not be written: remove the one from the last run too,
+ * a stale list would tickle connections that are long gone and miss
+ * the current ones.
+ */
+static void drop_outfile(const char *outfile, const char *tmpfile)
+{
+	if (!outfile)
+		return;
+	unlink(tmpfile);
+	if (unlink(outfile) && errno != ENOENT)
+		fprintf(stderr, "Cannot remove %s (%s)\n", outfile, strerror(errno));
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/tcp_conns [ -p ports ] [ -a ] [ -q ] [ -o file ] ip[/prefix]\n");
+	printf("  -p ports : only local ports in the list, e.g. 80,443,1000:2000\n");
+	printf("  -a       : all states but LISTEN, not only ESTABLISHED\n");
+	printf("  -q       : print nothing, exit 0 if there is any connection, 1 if not\n");
+	printf("  -o file  : write the list to file.new, sync it and rename it to file;\n");
+	printf("             on failure file is removed\n");
+	exit(1);
+}
+
+#define OPTION_STRING "p:aqo:h"
+
+int main(int argc, char *argv[])
+{
+	int optchar, cont = 1, nranges = 0, prefix_len, fd, ret = 0, i;
+	const char *outfile = NULL;
+	char *addr, *p, tmpfile[4096];
+	unsigned int states = 1 << TCP_ESTABLISHED;
+	struct tcp_port_range ranges[MAX_RANGES];
+	union {
+		struct sockaddr     sa;
+		struct sockaddr_in  ip;
+		struct sockaddr_in6 ip6;
+	} local;
+	struct conns_out out;
+	unsigned char bc[1024];
+	int bclen;
+
+	memset(&out, 0, sizeof(out));
+	out.f = stdout;
+
+	while(cont) {
+		optchar = getopt(argc, argv, OPTION_STRING);
+		switch(optchar) {
+		case 'p':
+			nranges = parse_ports(optarg, ranges, MAX_RANGES);
+			if (nranges < 0) {
+				fprintf(stderr, "Bad port list '%s'\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'a':
+			states = ~(1U << TCP_LISTEN);
+			break;
+		case 'q':
+			out.quiet = 1;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'h':
+			usage();
+			break;
+		case EOF:
+			cont = 0;
+			break;
+		default:
+			fprintf(stderr, "unknown option, please use '-h' for usage.\n");
+			exit(EXIT_FAILURE);
+			break;
+		};
+	}
+
+	if (optind != argc - 1)
+		usage();
+
+	addr = strdup(argv[optind]);
+	if (!addr) {
+		fprintf(stderr, "Failed strdup()\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(&local, 0, sizeof(local));
+	prefix_len = -1;
+	if ((p = strchr(addr, '/')) != NULL) {
+		*p++ = 0;
+		prefix_len = atoi(p);
+	}
+	if (inet_pton(AF_INET, addr, &local.ip.sin_addr) == 1) {
+		local.sa.sa_family = AF_INET;
+		if (prefix_len < 0 || prefix_len > 32)
+			prefix_len = 32;
+	} else if (inet_pton(AF_INET6, addr, &local.ip6.sin6_addr) == 1) {
+		local.sa.sa_family = AF_INET6;
+		if (prefix_len < 0 || prefix_len > 128)
+			prefix_len = 128;
+	} else {
+		fprintf(stderr, "Bad IP address '%s'\n", argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+	free(addr);
+
+	bclen = tcp_diag_filter(bc, sizeof(bc), &local.sa, prefix_len, ranges, nranges);
+	if (bclen < 0) {
+		fprintf(stderr, "Too many port ranges\n");
+		exit(EXIT_FAILURE);
+	}
+
+	/* -q writes no list */
+	if (out.quiet)
+		outfile = NULL;
+	if (outfile) {
+		if (snprintf(tmpfile, sizeof(tmpfile), "%s.new", outfile) >= (int)sizeof(tmpfile)) {
+			fprintf(stderr, "File name too long\n");
+			exit(EXIT_FAILURE);
+		}
+		out.f = fopen(tmpfile, "w");
+		if (!out.f) {
+			fprintf(stderr, "Cannot open %s (%s)\n", tmpfile, strerror(errno));
+			drop_outfile(outfile, tmpfile);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	fd = tcp_diag_open();
+	if (fd < 0) {
+		drop_outfile(outfile, tmpfile);
+		exit(EXIT_FAILURE);
+	}
+
+	/* IPv4 connections may also live on AF_INET6 sockets, v4-mapped */
+	for (i = 0; i < 2 && !ret; i++) {
+		int family = i ? AF_INET6 : AF_INET;
+
+		if (family == AF_INET && local.sa.sa_family == AF_INET6)
+			continue;
+		if (out.quiet && out.count)
+			break;
+		ret = tcp_diag_dump(fd, family, states, bc, bclen, print_conn, &out);
+		/* no IPv6 in this kernel is not an error */
+		if (family == AF_INET6 && local.sa.sa_family == AF_INET && ret == -ENOENT)
+			ret = 0;
+	}
+	close(fd);
+
+	if (ret) {
+		fprintf(stderr, "Failed to list TCP sockets (%s)\n", strerror(-ret));
+		drop_outfile(outfile, tmpfile);
+		exit(EXIT_FAILURE);
+	}
+
+	if (out.quiet)
+		return out.count ? 0 : 1;
+
+	if (outfile) {
+		if (fflush(out.f) || fsync(fileno(out.f)) || fclose(out.f)
+		||  rename(tmpfile, outfile)) {
+			fprintf(stderr, "Cannot write %s (%s)\n", outfile, strerror(errno));
+			drop_outfile(outfile, tmpfile);
+			exit(EXIT_FAILURE);
+		}
+	}
+	return 0;
+}
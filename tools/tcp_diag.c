@@ -0,0 +1,268 @@
+/*
+   TCP socket diagnostics (NETLINK_SOCK_DIAG) helpers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+#include "tcp_diag.h"
+
+#ifndef SOCK_DESTROY
+#define SOCK_DESTROY 21
+#endif
+
+static void tcp_diag_fill_id(struct inet_diag_sockid *id,
+			     const struct sockaddr *local,
+			     const struct sockaddr *remote)
+{
+	const struct sockaddr_in *l4 = (const struct sockaddr_in *)(const void *)local;
+	const struct sockaddr_in *r4 = (const struct sockaddr_in *)(const void *)remote;
+	const struct sockaddr_in6 *l6 = (const struct sockaddr_in6 *)(const void *)local;
+	const struct sockaddr_in6 *r6 = (const struct sockaddr_in6 *)(const void *)remote;
+
+	memset(id, 0, sizeof(*id));
+	if (local->sa_family == AF_INET6) {
+		id->idiag_sport = l6->sin6_port;
+		id->idiag_dport = r6->sin6_port;
+		memcpy(id->idiag_src, &l6->sin6_addr, 16);
+		memcpy(id->idiag_dst, &r6->sin6_addr, 16);
+	} else {
+		id->idiag_sport = l4->sin_port;
+		id->idiag_dport = r4->sin_port;
+		id->idiag_src[0] = l4->sin_addr.s_addr;
+		id->idiag_dst[0] = r4->sin_addr.s_addr;
+	}
+	id->idiag_cookie[0] = INET_DIAG_NOCOOKIE;
+	id->idiag_cookie[1] = INET_DIAG_NOCOOKIE;
+}
+
+int tcp_diag_open(void)
+{
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open sock_diag socket (%s)\n", strerror(errno));
+		return -1;
+	}
+	return fd;
+}
+
+int tcp_diag_destroy(int fd, const struct sockaddr *local,
+		     const struct sockaddr *remote)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct inet_diag_req_v2 req;
+	} msg;
+	union {
+		struct nlmsghdr nlh;
+		char buf[256];
+	} reply;
+	struct sockaddr_nl nladdr;
+	struct nlmsgerr *err;
+	ssize_t len;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.nlh.nlmsg_len = sizeof(msg);
+	msg.nlh.nlmsg_type = SOCK_DESTROY;
+	msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	msg.req.sdiag_family = local->sa_family;
+	msg.req.sdiag_protocol = IPPROTO_TCP;
+	msg.req.idiag_states = ~0U;
+	tcp_diag_fill_id(&msg.req.id, local, remote);
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+
+	if (sendto(fd, &msg, sizeof(msg), 0,
+		   (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0)
+		return -errno;
+
+	do {
+		len = recv(fd, &reply, sizeof(reply), 0);
+	} while (len < 0 && errno == EINTR);
+	if (len < 0)
+		return -errno;
+
+	if (!NLMSG_OK(&reply.nlh, (size_t)len)
+	||  reply.nlh.nlmsg_type != NLMSG_ERROR
+	||  reply.nlh.nlmsg_len < NLMSG_LENGTH(sizeof(*err)))
+		return -EPROTO;
+
+	err = NLMSG_DATA(&reply.nlh);
+	return err->error;
+}
+
+/* Append one bytecode op, return a pointer to it. */
+static struct inet_diag_bc_op *bc_op(unsigned char *buf, size_t *off,
+				     unsigned char code, unsigned char yes,
+				     unsigned short no)
+{
+	struct inet_diag_bc_op *op = (struct inet_diag_bc_op *)(void *)(buf + *off);
+
+	op->code = code;
+	op->yes = yes;
+	op->no = no;
+	*off += sizeof(*op);
+	return op;
+}
+
+int tcp_diag_filter(void *buf, size_t buflen,
+		    const struct sockaddr *local, int prefix_len,
+		    const struct tcp_port_range *ranges, int nranges)
+{
+	unsigned char *bc = buf;
+	struct inet_diag_hostcond *hc;
+	size_t need, hclen = 0, off = 0, end;
+	int i;
+
+	/*
+	 * The program is walked along the "yes" offsets; a match is
+	 * landing exactly on its end, jumping 4 bytes past it rejects.
+	 *
+	 *   S_COND local/prefix      no: reject
+	 *   S_GE lo0, S_LE hi0       no: next range (reject for the last)
+	 *   JMP                      always to the end (accept)
+	 *   S_GE lo1, S_LE hi1 ...
+	 */
+	if (local)
+		hclen = sizeof(struct inet_diag_bc_op) + sizeof(*hc)
+			+ (local->sa_family == AF_INET6 ? 16 : 4);
+	need = hclen + nranges * 4 * sizeof(struct inet_diag_bc_op)
+		+ (nranges > 0 ? (nranges - 1) * sizeof(struct inet_diag_bc_op) : 0);
+	if (need > buflen || need > 0xffff)
+		return -1;
+	end = need;
+
+	if (local) {
+		bc_op(bc, &off, INET_DIAG_BC_S_COND, hclen, end - off + 4);
+		hc = (struct inet_diag_hostcond *)(void *)(bc + off);
+		hc->family = local->sa_family;
+		hc->prefix_len = prefix_len;
+		hc->port = -1;
+		if (local->sa_family == AF_INET6)
+			memcpy(hc->addr, &((const struct sockaddr_in6 *)(const void *)local)->sin6_addr, 16);
+		else
+			memcpy(hc->addr, &((const struct sockaddr_in *)(const void *)local)->sin_addr, 4);
+		off += hclen - sizeof(struct inet_diag_bc_op);
+	}
+
+	for (i = 0; i < nranges; i++) {
+		int last = (i == nranges - 1);
+		/* the next range starts after GE, LE and JMP (20 bytes) */
+		size_t next = off + 5 * sizeof(struct inet_diag_bc_op);
+
+		bc_op(bc, &off, INET_DIAG_BC_S_GE, 8,
+		      last ? end - off + 4 : next - off);
+		bc_op(bc, &off, 0, 0, ranges[i].lo);
+		bc_op(bc, &off, INET_DIAG_BC_S_LE, 8,
+		      last ? end - off + 4 : next - off);
+		bc_op(bc, &off, 0, 0, ranges[i].hi);
+		if (!last)
+			bc_op(bc, &off, INET_DIAG_BC_JMP, 4, end - off);
+	}
+
+	return off;
+}
+
+int tcp_diag_dump(int fd, int family, unsigned int states,
+		  const void *bytecode, size_t bclen,
+		  tcp_diag_cb cb, void *arg)
+{
+	struct nlmsghdr *nlh;
+	struct inet_diag_req_v2 *req;
+	struct nlattr *nla;
+	struct sockaddr_nl nladdr;
+	size_t msglen;
+	char *msg;
+	static char buf[32768];
+	ssize_t len;
+	int ret = 0, done = 0;
+
+	msglen = NLMSG_LENGTH(sizeof(*req));
+	if (bclen)
+		msglen = NLMSG_ALIGN(msglen) + NLA_HDRLEN + NLA_ALIGN(bclen);
+	msg = calloc(1, msglen);
+	if (!msg)
+		return -ENOMEM;
+
+	nlh = (struct nlmsghdr *)(void *)msg;
+	nlh->nlmsg_len = msglen;
+	nlh->nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req = NLMSG_DATA(nlh);
+	req->sdiag_family = family;
+	req->sdiag_protocol = IPPROTO_TCP;
+	req->idiag_states = states;
+	if (bclen) {
+		nla = (struct nlattr *)(void *)(msg + NLMSG_ALIGN(NLMSG_LENGTH(sizeof(*req))));
+		nla->nla_type = INET_DIAG_REQ_BYTECODE;
+		nla->nla_len = NLA_HDRLEN + bclen;
+		memcpy((char *)nla + NLA_HDRLEN, bytecode, bclen);
+	}
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+
+	if (sendto(fd, msg, msglen, 0,
+		   (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		ret = -errno;
+		free(msg);
+		return ret;
+	}
+	free(msg);
+
+	/* keep reading to the end even if cb asked to stop */
+	while (!done) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (len == 0)
+			break;
+
+		for (nlh = (struct nlmsghdr *)(void *)buf; NLMSG_OK(nlh, (size_t)len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(nlh);
+				ret = err->error ? err->error : -EPROTO;
+				done = 1;
+				break;
+			}
+			if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY || ret)
+				continue;
+			ret = cb(NLMSG_DATA(nlh), arg);
+		}
+	}
+
+	return ret < 0 ? ret : 0;
+}
@@ -0,0 +1,64 @@
+/*
+   TCP socket diagnostics (NETLINK_SOCK_DIAG) helpers
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+   
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+   
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TCP_DIAG_H
+#define TCP_DIAG_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+#include <linux/inet_diag.h>
+
+struct tcp_port_range {
+	unsigned short lo;
+	unsigned short hi;
+};
+
+typedef int (*tcp_diag_cb)(const struct inet_diag_msg *msg, void *arg);
+
+/* Open a NETLINK_SOCK_DIAG socket, -1 on error. */
+int tcp_diag_open(void);
+
+/*
+ * Abort the local TCP socket local <-> remote (SOCK_DESTROY).  The
+ * kernel sends the peer a RST carrying the right sequence number.
+ * Returns 0, or -errno: -ENOENT if there is no such socket,
+ * -EOPNOTSUPP if the kernel lacks CONFIG_INET_DIAG_DESTROY.
+ */
+int tcp_diag_destroy(int fd, const struct sockaddr *local,
+		     const struct sockaddr *remote);
+
+/*
+ * Compile an inet_diag bytecode filter matching sockets whose local
+ * address is within local/prefix_len (local may be NULL for any) and
+ * whose local port falls into one of the ranges (nranges may be 0).
+ * Returns the bytecode length, or -1 if buf is too small.
+ */
+int tcp_diag_filter(void *buf, size_t buflen,
+		    const struct sockaddr *local, int prefix_len,
+		    const struct tcp_port_range *ranges, int nranges);
+
+/*
+ * Dump the TCP sockets of one family in the given states (a bitmask of
+ * 1 << TCP_xxx), filtered in the kernel by the bytecode, calling cb for
+ * every socket.  A non-zero return of cb stops the dump.
+ * Returns 0, or -errno.
+ */
+int tcp_diag_dump(int fd, int family, unsigned int states,
+		  const void *bytecode, size_t bclen,
+		  tcp_diag_cb cb, void *arg);
+
+#endif
@@ -25,6 +25,9 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <netinet/tcp.h>
@@ -33,7 +36,7 @@
 #include <arpa/inet.h>
 #include <net/if.h>
 
-#define discard_const(ptr) ((void *)((intptr_t)(ptr)))
+#include "tcp_diag.h"
 
 typedef union {
 	struct sockaddr     sa;
@@ -41,16 +44,111 @@ typedef union {
 	struct sockaddr_in6 ip6;
 } sock_addr;
 
+struct tickle_conn {
+	sock_addr src;
+	sock_addr dst;
+	int done;
+};
+
+struct ip4pkt {
+	struct iphdr ip;
+	struct tcphdr tcp;
+};
+
+struct ip6pkt {
+	struct ip6_hdr ip6;
+	struct tcphdr tcp;
+};
+
+#define TICKLE_PKT_MAX	sizeof(struct ip6pkt)
+
+#define DEFAULT_BATCH	64
+
+struct tickle_opts {
+	int num;
+	double rate;
+	double burst;
+	double window;
+	unsigned int batch;
+	int threads;
+	int kill;
+	struct timespec start;
+};
+
+/*
+ * Packets queued for one sendmmsg() call on a raw socket of one
+ * address family.  Each worker owns one batch per family.
+ */
+struct tickle_batch {
+	int family;
+	int fd;
+	unsigned int n;
+	unsigned int max;
+	struct mmsghdr *msgs;
+	struct iovec *iovs;
+	sock_addr *dsts;
+	unsigned char *pkts;
+};
+
+/*
+ * Token bucket used to pace the tickles: "rate" tokens per second
+ * are added, at most "burst" of them are kept, and each packet
+ * consumes one.  A rate of 0 disables pacing.
+ */
+struct pacer {
+	double rate;
+	double burst;
+	double tokens;
+	struct timespec last;
+};
+
+/*
+ * Every worker tickles its own shard of the connections with its own
+ * sockets, batches and pacer; the counters are only read by the main
+ * thread once the worker has been joined.
+ */
+struct tickle_worker {
+	pthread_t thread;
+	int started;
+	int cpu;
+	const struct tickle_opts *opts;
+	struct tickle_conn *conns;
+	size_t nconns;
+	struct tickle_batch b4;
+	struct tickle_batch b6;
+	struct pacer pacer;
+	int nl;
+	unsigned long sent;
+	unsigned long killed;
+	unsigned long errors;
+};
+
 uint32_t uint16_checksum(uint16_t *data, size_t n);
-void set_nonblocking(int fd);
 void set_close_on_exec(int fd);
 static int parse_ipv4(const char *s, unsigned port, struct sockaddr_in *sin);
 static int parse_ipv6(const char *s, const char *iface, unsigned port, sock_addr *saddr);
 int parse_ip(const char *addr, const char *iface, unsigned port, sock_addr *saddr);
 int parse_ip_port(const char *addr, sock_addr *saddr);
-int send_tickle_ack(const sock_addr *dst, 
-		    const sock_addr *src, 
-		    uint32_t seq, uint32_t ack, int rst);
+int build_tickle_ack(unsigned char *pkt,
+		     const sock_addr *dst,
+		     const sock_addr *src,
+		     uint32_t seq, uint32_t ack, int rst);
+int open_tickle_socket(int family);
+static int batch_init(struct tickle_batch *b, int family, unsigned int max);
+static void batch_free(struct tickle_batch *b);
+static unsigned long batch_flush(struct tickle_batch *b);
+static unsigned long batch_add(struct tickle_batch *b, const struct tickle_conn *c);
+static const char *addr_str(const sock_addr *addr, char *buf, size_t len);
+static double ts_diff(const struct timespec *a, const struct timespec *b);
+static void ts_add_ms(struct timespec *ts, double ms);
+static void sleep_until(const struct timespec *when);
+static void pacer_init(struct pacer *p, double rate, double burst);
+static void pacer_wait(struct pacer *p);
+static int read_conns(FILE *f, struct tickle_conn **conns, size_t *nconns);
+static unsigned int conn_shard(const struct tickle_conn *c, int nworkers);
+static int nth_cpu(int n);
+static int kill_local(struct tickle_worker *w, struct tickle_conn *c);
+static void *worker_run(void *arg);
 static void usage(void);
 
 uint32_t uint16_checksum(uint16_t *data, size_t n)
@@ -88,16 +186,15 @@ static uint16_t tcp_checksum(uint16_t *data, size_t n, struct iphdr *ip)
 
 static uint16_t tcp_checksum6(uint16_t *data, size_t n, struct ip6_hdr *ip6)
 {
-	uint32_t phdr[2];
 	uint32_t sum = 0;
 	uint16_t sum2;
 
 	sum += uint16_checksum((uint16_t *)(void *)&ip6->ip6_src, 16);
 	sum += uint16_checksum((uint16_t *)(void *)&ip6->ip6_dst, 16);
 
-	phdr[0] = htonl(n);
-	phdr[1] = htonl(ip6->ip6_nxt);
-	sum += uint16_checksum((uint16_t *)phdr, 8);
+	/* pseudo header: 32 bit upper layer length, 24 zero bits, next header */
+	sum += (uint32_t)(n >> 16) + (uint32_t)(n & 0xFFFF);
+	sum += ip6->ip6_nxt;
 
 	sum += uint16_checksum(data, n);
 
@@ -111,13 +208,6 @@ static uint16_t tcp_checksum6(uint16_t *data, size_t n, struct ip6_hdr *ip6)
 	return sum2;
 }
 
-void set_nonblocking(int fd)
-{
-	unsigned v;
-	v = fcntl(fd, F_GETFL, 0);
-	fcntl(fd, F_SETFL, v | O_NONBLOCK);
-}
-
 void set_close_on_exec(int fd) 
 {               
 	unsigned v;
@@ -204,141 +294,474 @@ int parse_ip_port(const char *addr, sock_addr *saddr)
 	return ret;
 }
 
-int send_tickle_ack(const sock_addr *dst, 
-		    const sock_addr *src, 
-		    uint32_t seq, uint32_t ack, int rst)
+/*
+ * Build the tickle packet (IP + TCP header) into pkt, which must hold
+ * TICKLE_PKT_MAX bytes.  Returns the packet length, or -1.
+ */
+int build_tickle_ack(unsigned char *pkt,
+		     const sock_addr *dst,
+		     const sock_addr *src,
+		     uint32_t seq, uint32_t ack, int rst)
 {
-	int s;
-	int ret;
-	uint32_t one = 1;
-	uint16_t tmpport;
-	sock_addr *tmpdest;
-	struct {
-		struct iphdr ip;
-		struct tcphdr tcp;
-	} ip4pkt;
-	struct {
-		struct ip6_hdr ip6;
-		struct tcphdr tcp;
-	} ip6pkt;
+	struct ip4pkt *ip4pkt = (struct ip4pkt *)(void *)pkt;
+	struct ip6pkt *ip6pkt = (struct ip6pkt *)(void *)pkt;
 
 	switch (src->ip.sin_family) {
 	case AF_INET:
-		memset(&ip4pkt, 0, sizeof(ip4pkt));
-		ip4pkt.ip.version  = 4;
-		ip4pkt.ip.ihl      = sizeof(ip4pkt.ip)/4;
-		ip4pkt.ip.tot_len  = htons(sizeof(ip4pkt));
-		ip4pkt.ip.ttl      = 255;
-		ip4pkt.ip.protocol = IPPROTO_TCP;
-		ip4pkt.ip.saddr    = src->ip.sin_addr.s_addr;
-		ip4pkt.ip.daddr    = dst->ip.sin_addr.s_addr;
-		ip4pkt.ip.check    = 0;
-
-		ip4pkt.tcp.source  = src->ip.sin_port;
-		ip4pkt.tcp.dest    = dst->ip.sin_port;
-		ip4pkt.tcp.seq     = seq;
-		ip4pkt.tcp.ack_seq = ack;
-		ip4pkt.tcp.ack     = 1;
+		memset(ip4pkt, 0, sizeof(*ip4pkt));
+		ip4pkt->ip.version  = 4;
+		ip4pkt->ip.ihl      = sizeof(ip4pkt->ip)/4;
+		ip4pkt->ip.tot_len  = htons(sizeof(*ip4pkt));
+		ip4pkt->ip.ttl      = 255;
+		ip4pkt->ip.protocol = IPPROTO_TCP;
+		ip4pkt->ip.saddr    = src->ip.sin_addr.s_addr;
+		ip4pkt->ip.daddr    = dst->ip.sin_addr.s_addr;
+		ip4pkt->ip.check    = 0;
+
+		ip4pkt->tcp.source  = src->ip.sin_port;
+		ip4pkt->tcp.dest    = dst->ip.sin_port;
+		ip4pkt->tcp.seq     = seq;
+		ip4pkt->tcp.ack_seq = ack;
+		ip4pkt->tcp.ack     = 1;
 		if (rst)
-			ip4pkt.tcp.rst = 1;
-		ip4pkt.tcp.doff    = sizeof(ip4pkt.tcp)/4;
-		ip4pkt.tcp.window   = htons(1234);
-		ip4pkt.tcp.check    = tcp_checksum((uint16_t *)&ip4pkt.tcp, sizeof(ip4pkt.tcp), &ip4pkt.ip);
-
-		s = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
-		if (s == -1) {
-			fprintf(stderr, "Failed to open raw socket (%s)\n", strerror(errno));
-			return -1;
-		}
+			ip4pkt->tcp.rst = 1;
+		ip4pkt->tcp.doff    = sizeof(ip4pkt->tcp)/4;
+		ip4pkt->tcp.window   = htons(1234);
+		ip4pkt->tcp.check    = tcp_checksum((uint16_t *)&ip4pkt->tcp, sizeof(ip4pkt->tcp), &ip4pkt->ip);
+		return sizeof(*ip4pkt);
 
-		ret = setsockopt(s, SOL_IP, IP_HDRINCL, &one, sizeof(one));
-		if (ret != 0) {
-			fprintf(stderr, "Failed to setup IP headers (%s)\n", strerror(errno));
-			close(s);
-			return -1;
-		}
+        case AF_INET6:
+		memset(ip6pkt, 0, sizeof(*ip6pkt));
+		ip6pkt->ip6.ip6_vfc  = 0x60;
+		ip6pkt->ip6.ip6_plen = htons(20);
+		ip6pkt->ip6.ip6_nxt  = IPPROTO_TCP;
+		ip6pkt->ip6.ip6_hlim = 64;
+		ip6pkt->ip6.ip6_src  = src->ip6.sin6_addr;
+		ip6pkt->ip6.ip6_dst  = dst->ip6.sin6_addr;
+
+		ip6pkt->tcp.source   = src->ip6.sin6_port;
+		ip6pkt->tcp.dest     = dst->ip6.sin6_port;
+		ip6pkt->tcp.seq      = seq;
+		ip6pkt->tcp.ack_seq  = ack;
+		ip6pkt->tcp.ack      = 1;
+		if (rst)
+			ip6pkt->tcp.rst      = 1;
+		ip6pkt->tcp.doff     = sizeof(ip6pkt->tcp)/4;
+		ip6pkt->tcp.window   = htons(1234);
+		ip6pkt->tcp.check    = tcp_checksum6((uint16_t *)&ip6pkt->tcp, sizeof(ip6pkt->tcp), &ip6pkt->ip6);
+		return sizeof(*ip6pkt);
+
+	default:
+		fprintf(stderr, "Not an ipv4/v6 address\n");
+		return -1;
+	}
+}
+
+/* Raw socket used to send tickles of the given family. */
+int open_tickle_socket(int family)
+{
+	int s;
+	uint32_t one = 1;
 
-		set_nonblocking(s);
-		set_close_on_exec(s);
+	s = socket(family, SOCK_RAW, IPPROTO_RAW);
+	if (s == -1) {
+		fprintf(stderr, "Failed to open raw socket (%s)\n", strerror(errno));
+		return -1;
+	}
 
-		ret = sendto(s, &ip4pkt, sizeof(ip4pkt), 0, 
-			     (const struct sockaddr *)&dst->ip, sizeof(dst->ip));
+	if (family == AF_INET &&
+	    setsockopt(s, SOL_IP, IP_HDRINCL, &one, sizeof(one)) != 0) {
+		fprintf(stderr, "Failed to setup IP headers (%s)\n", strerror(errno));
 		close(s);
-		if (ret != sizeof(ip4pkt)) {
-			fprintf(stderr, "Failed sendto (%s)\n", strerror(errno));
-			return -1;
+		return -1;
+	}
+
+	set_close_on_exec(s);
+	return s;
+}
+
+static int batch_init(struct tickle_batch *b, int family, unsigned int max)
+{
+	unsigned int i;
+
+	memset(b, 0, sizeof(*b));
+	b->family = family;
+	b->fd = -1;
+	b->max = max;
+	b->msgs = calloc(max, sizeof(*b->msgs));
+	b->iovs = calloc(max, sizeof(*b->iovs));
+	b->dsts = calloc(max, sizeof(*b->dsts));
+	b->pkts = calloc(max, TICKLE_PKT_MAX);
+	if (!b->msgs || !b->iovs || !b->dsts || !b->pkts) {
+		fprintf(stderr, "Failed calloc()\n");
+		return -1;
+	}
+
+	for (i = 0; i < max; i++) {
+		b->iovs[i].iov_base = b->pkts + i * TICKLE_PKT_MAX;
+		b->msgs[i].msg_hdr.msg_iov = &b->iovs[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+		b->msgs[i].msg_hdr.msg_name = &b->dsts[i];
+		b->msgs[i].msg_hdr.msg_namelen = sizeof(b->dsts[i]);
+	}
+	return 0;
+}
+
+static void batch_free(struct tickle_batch *b)
+{
+	if (b->fd >= 0)
+		close(b->fd);
+	free(b->msgs);
+	free(b->iovs);
+	free(b->dsts);
+	free(b->pkts);
+}
+
+/* Send everything queued in the batch. Returns the number of failures. */
+static unsigned long batch_flush(struct tickle_batch *b)
+{
+	char addr[INET6_ADDRSTRLEN];
+	unsigned int done = 0;
+	int ret;
+
+	if (!b->n)
+		return 0;
+
+	if (b->fd < 0) {
+		b->fd = open_tickle_socket(b->family);
+		if (b->fd < 0) {
+			ret = b->n;
+			b->n = 0;
+			return ret;
 		}
-		break;
+	}
 
-        case AF_INET6:
-		memset(&ip6pkt, 0, sizeof(ip6pkt));
-		ip6pkt.ip6.ip6_vfc  = 0x60;
-		ip6pkt.ip6.ip6_plen = htons(20);
-		ip6pkt.ip6.ip6_nxt  = IPPROTO_TCP;
-		ip6pkt.ip6.ip6_hlim = 64;
-		ip6pkt.ip6.ip6_src  = src->ip6.sin6_addr;
-		ip6pkt.ip6.ip6_dst  = dst->ip6.sin6_addr;
-
-		ip6pkt.tcp.source   = src->ip6.sin6_port;
-		ip6pkt.tcp.dest     = dst->ip6.sin6_port;
-		ip6pkt.tcp.seq      = seq;
-		ip6pkt.tcp.ack_seq  = ack;
-		ip6pkt.tcp.ack      = 1;
-		if (rst)
-			ip6pkt.tcp.rst      = 1;
-		ip6pkt.tcp.doff     = sizeof(ip6pkt.tcp)/4;
-		ip6pkt.tcp.window   = htons(1234);
-		ip6pkt.tcp.check    = tcp_checksum6((uint16_t *)&ip6pkt.tcp, sizeof(ip6pkt.tcp), &ip6pkt.ip6);
-
-		s = socket(PF_INET6, SOCK_RAW, IPPROTO_RAW);
-		if (s == -1) {
-			fprintf(stderr, "Failed to open sending socket\n");
-			return -1;
-                }
+	while (done < b->n) {
+		ret = sendmmsg(b->fd, b->msgs + done, b->n - done, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Error while sending tickle ack to '%s' (%s)\n",
+				addr_str(&b->dsts[done], addr, sizeof(addr)), strerror(errno));
+			break;
+		}
+		done += ret;
+	}
 
-		tmpdest = discard_const(dst);
-		tmpport = tmpdest->ip6.sin6_port;
+	ret = b->n - done;
+	b->n = 0;
+	return ret;
+}
 
-		tmpdest->ip6.sin6_port = 0;
-		ret = sendto(s, &ip6pkt, sizeof(ip6pkt), 0, (const struct sockaddr *)&dst->ip6, sizeof(dst->ip6));
-		tmpdest->ip6.sin6_port = tmpport;
-		close(s);
+/* Queue a tickle, sending the batch once it is full. */
+static unsigned long batch_add(struct tickle_batch *b, const struct tickle_conn *c)
+{
+	int len;
+
+	len = build_tickle_ack(b->iovs[b->n].iov_base, &c->dst, &c->src, 0, 0, 0);
+	if (len < 0)
+		return 1;
+
+	b->iovs[b->n].iov_len = len;
+	b->dsts[b->n] = c->dst;
+	if (b->family == AF_INET6)
+		b->dsts[b->n].ip6.sin6_port = 0;
+
+	if (++b->n == b->max)
+		return batch_flush(b);
+	return 0;
+}
+
+static const char *addr_str(const sock_addr *addr, char *buf, size_t len)
+{
+	const void *a;
+
+	if (addr->sa.sa_family == AF_INET6)
+		a = &addr->ip6.sin6_addr;
+	else
+		a = &addr->ip.sin_addr;
+	if (!inet_ntop(addr->sa.sa_family, a, buf, len))
+		snprintf(buf, len, "?");
+	return buf;
+}
+
+/* a - b, in seconds */
+static double ts_diff(const struct timespec *a, const struct timespec *b)
+{
+	return (double)(a->tv_sec - b->tv_sec)
+		+ (double)(a->tv_nsec - b->tv_nsec) / 1e9;
+}
+
+static void ts_add_ms(struct timespec *ts, double ms)
+{
+	long long ns;
+
+	ns = (long long)ts->tv_nsec + (long long)(ms * 1e6);
+	ts->tv_sec += ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+}
+
+static void sleep_until(const struct timespec *when)
+{
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, when, NULL) == EINTR)
+		;
+}
+
+static void pacer_init(struct pacer *p, double rate, double burst)
+{
+	p->rate   = rate;
+	p->burst  = burst < 1 ? 1 : burst;
+	p->tokens = p->burst;
+	clock_gettime(CLOCK_MONOTONIC, &p->last);
+}
 
-		if (ret != sizeof(ip6pkt)) {
-			fprintf(stderr, "Failed sendto (%s)\n", strerror(errno));
+/* Block until a token is available and take it. */
+static void pacer_wait(struct pacer *p)
+{
+	struct timespec now;
+
+	if (p->rate <= 0)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	p->tokens += ts_diff(&now, &p->last) * p->rate;
+	if (p->tokens > p->burst)
+		p->tokens = p->burst;
+	p->last = now;
+
+	if (p->tokens < 1) {
+		/* sleep just long enough for the missing fraction */
+		ts_add_ms(&now, (1 - p->tokens) * 1000 / p->rate);
+		sleep_until(&now);
+		p->tokens = 1;
+		p->last = now;
+	}
+	p->tokens -= 1;
+}
+
+/*
+ * Read the whole list of {local_ip:port remote_ip:port} pairs, so that
+ * the repeats can be scheduled over all of them at once.
+ */
+static int read_conns(FILE *f, struct tickle_conn **conns, size_t *nconns)
+{
+	char addrline[128], addr1[64], addr2[64];
+	struct tickle_conn *c = NULL, *tmp;
+	size_t n = 0, alloc = 0;
+
+	while(fgets(addrline, sizeof(addrline), f)) {
+		if (sscanf(addrline, "%63s %63s", addr1, addr2) != 2)
+			continue;
+
+		if (n == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			tmp = realloc(c, alloc * sizeof(*c));
+			if (!tmp) {
+				fprintf(stderr, "Failed realloc()\n");
+				free(c);
+				return -1;
+			}
+			c = tmp;
+		}
+
+		if (parse_ip_port(addr1, &c[n].src)) {
+			fprintf(stderr, "Bad IP:port '%s'\n", addr1);
+			free(c);
+			return -1;
+		}
+		if (parse_ip_port(addr2, &c[n].dst)) {
+			fprintf(stderr, "Bad IP:port '%s'\n", addr2);
+			free(c);
 			return -1;
 		}
-		break;
+		n++;
+	}
 
-	default:
-		fprintf(stderr, "Not an ipv4/v6 address\n");
+	*conns = c;
+	*nconns = n;
+	return 0;
+}
+
+/* Spread connections over the workers by destination. */
+static unsigned int conn_shard(const struct tickle_conn *c, int nworkers)
+{
+	uint32_t h = c->dst.ip.sin_port;
+
+	if (c->dst.sa.sa_family == AF_INET6) {
+		const uint32_t *a = (const uint32_t *)(const void *)&c->dst.ip6.sin6_addr;
+		h ^= a[0] ^ a[1] ^ a[2] ^ a[3];
+	} else {
+		h ^= c->dst.ip.sin_addr.s_addr;
+	}
+	h *= 2654435761U;
+	return (h >> 16) % nworkers;
+}
+
+/* Return the n-th CPU (modulo their number) we are allowed to run on. */
+static int nth_cpu(int n)
+{
+	cpu_set_t set;
+	int cpu, count;
+
+	if (sched_getaffinity(0, sizeof(set), &set) != 0)
 		return -1;
+	count = CPU_COUNT(&set);
+	if (count <= 0)
+		return -1;
+	n %= count;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &set) && n-- == 0)
+			return cpu;
 	}
+	return -1;
+}
+
+/*
+ * If either end of the connection is a local socket, have the kernel
+ * abort it: that RST carries the real sequence numbers, which we
+ * cannot learn from sock_diag and so could never put in a tickle.
+ * Returns 1 if the connection was taken care of this way.
+ */
+static int kill_local(struct tickle_worker *w, struct tickle_conn *c)
+{
+	int ret;
+
+	if (w->nl < 0)
+		return 0;
 
+	ret = tcp_diag_destroy(w->nl, &c->dst.sa, &c->src.sa);
+	if (ret == -ENOENT)
+		ret = tcp_diag_destroy(w->nl, &c->src.sa, &c->dst.sa);
+	if (ret == 0) {
+		c->done = 1;
+		w->killed++;
+		return 1;
+	}
+	if (ret != -ENOENT) {
+		fprintf(stderr, "Cannot destroy local sockets (%s), sending tickle acks only\n",
+			strerror(-ret));
+		close(w->nl);
+		w->nl = -1;
+	}
 	return 0;
 }
 
+static void *worker_run(void *arg)
+{
+	struct tickle_worker *w = arg;
+	const struct tickle_opts *o = w->opts;
+	struct tickle_batch *b;
+	struct timespec when;
+	cpu_set_t set;
+	size_t c;
+	int i;
+
+	if (w->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+			fprintf(stderr, "Failed to pin worker to CPU %d\n", w->cpu);
+	}
+
+	pacer_init(&w->pacer, o->rate / o->threads, o->burst / o->threads);
+	w->nl = o->kill ? tcp_diag_open() : -1;
+
+	for (i = 0; i < o->num; i++) {
+		if (i > 0 && o->window > 0) {
+			w->errors += batch_flush(&w->b4);
+			w->errors += batch_flush(&w->b6);
+			/* absolute schedule, so sending time does not add up */
+			when = o->start;
+			ts_add_ms(&when, o->window * i / (o->num - 1));
+			sleep_until(&when);
+		}
+		for (c = 0; c < w->nconns; c++) {
+			if (w->conns[c].done)
+				continue;
+			/* a destroy sends no packet, only tickles are paced */
+			if (kill_local(w, &w->conns[c]))
+				continue;
+			pacer_wait(&w->pacer);
+			b = w->conns[c].src.sa.sa_family == AF_INET6 ? &w->b6 : &w->b4;
+			w->errors += batch_add(b, &w->conns[c]);
+			w->sent++;
+		}
+	}
+	w->errors += batch_flush(&w->b4);
+	w->errors += batch_flush(&w->b6);
+	if (w->nl >= 0)
+		close(w->nl);
+	return NULL;
+}
+
 static void usage(void)
 {
-	printf("Usage: /usr/lib/heartbeat/tickle_tcp [ -n num ]\n");
+	printf("Usage: /usr/lib/heartbeat/tickle_tcp [ -n num ] [ -r rate ] [ -b burst ] [ -w window ]\n");
+	printf("                                     [ -t threads ] [ -a ] [ -B batch ] [ -k ] [ -v ]\n");
+	printf("  -n num     : send every tickle num times\n");
+	printf("  -r rate    : send at most rate packets per second (0: unlimited)\n");
+	printf("  -b burst   : allow bursts of up to burst packets when pacing\n");
+	printf("  -w window  : spread the num repeats evenly over window milliseconds\n");
+	printf("  -t threads : shard the connections by destination over threads workers\n");
+	printf("  -a         : pin every worker to its own CPU\n");
+	printf("  -B batch   : send up to batch packets per system call (default %d)\n", DEFAULT_BATCH);
+	printf("  -k         : abort local sockets of the connections instead (the kernel\n");
+	printf("               sends a correctly sequenced RST), tickle the others\n");
+	printf("  -v         : print statistics when done\n");
 	printf("Please note that this program need to read the list of\n");
 	printf("{local_ip:port remote_ip:port} from stdin.\n");
 	exit(1);
 }
 
-#define OPTION_STRING "n:h"
+#define OPTION_STRING "n:r:b:w:t:aB:kvh"
 
 int main(int argc, char *argv[])
 {
-	int optchar, i, num = 1, cont = 1;
-	sock_addr src, dst;
-	char addrline[128], addr1[64], addr2[64];
+	int optchar, i, cont = 1, pin = 0, verbose = 0;
+	struct tickle_opts opts;
+	struct tickle_conn *conns = NULL;
+	struct tickle_worker *workers;
+	struct timespec end;
+	unsigned long sent = 0, killed = 0, errors = 0;
+	unsigned int batch;
+	size_t nconns, c;
+	double elapsed;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.num = 1;
+	opts.burst = 16;
+	opts.batch = DEFAULT_BATCH;
+	opts.threads = 1;
 
 	while(cont) {
 		optchar = getopt(argc, argv, OPTION_STRING);
 		switch(optchar) {
 		case 'n':
-			num = atoi(optarg);
+			opts.num = atoi(optarg);
+			break;
+		case 'r':
+			opts.rate = atof(optarg);
+			break;
+		case 'b':
+			opts.burst = atof(optarg);
+			break;
+		case 'w':
+			opts.window = atof(optarg);
+			break;
+		case 't':
+			opts.threads = atoi(optarg);
+			break;
+		case 'a':
+			pin = 1;
+			break;
+		case 'B':
+			opts.batch = atoi(optarg);
+			break;
+		case 'k':
+			opts.kill = 1;
+			break;
+		case 'v':
+			verbose = 1;
 			break;
 		case 'h':
 			usage();
@@ -354,26 +777,80 @@ int main(int argc, char *argv[])
 		};
 	}
 
-	while(fgets(addrline, sizeof(addrline), stdin)) {
-		sscanf(addrline, "%s %s", addr1, addr2);
+	if (read_conns(stdin, &conns, &nconns))
+		return -1;
 
-		if (parse_ip_port(addr1, &src)) {
-			fprintf(stderr, "Bad IP:port '%s'\n", addr1);
-			return -1;
-		}
-		if (parse_ip_port(addr2, &dst)) {
-			fprintf(stderr, "Bad IP:port '%s'\n", addr2);
+	if (opts.threads < 1)
+		opts.threads = 1;
+	if ((size_t)opts.threads > nconns)
+		opts.threads = nconns ? nconns : 1;
+	if (opts.batch < 1)
+		opts.batch = 1;
+	/* keep the pacer in charge: never queue more than a burst */
+	batch = opts.batch;
+	if (opts.rate > 0 && opts.burst / opts.threads < batch)
+		batch = opts.burst / opts.threads < 1 ? 1 : opts.burst / opts.threads;
+
+	workers = calloc(opts.threads, sizeof(*workers));
+	if (!workers) {
+		fprintf(stderr, "Failed calloc()\n");
+		return -1;
+	}
+	for (c = 0; c < nconns; c++)
+		workers[conn_shard(&conns[c], opts.threads)].nconns++;
+	for (i = 0; i < opts.threads; i++) {
+		struct tickle_worker *w = &workers[i];
+
+		w->opts = &opts;
+		w->cpu = pin ? nth_cpu(i) : -1;
+		w->conns = malloc((w->nconns ? w->nconns : 1) * sizeof(*w->conns));
+		if (!w->conns
+		||  batch_init(&w->b4, AF_INET, batch)
+		||  batch_init(&w->b6, AF_INET6, batch)) {
+			fprintf(stderr, "Failed to set up worker %d\n", i);
 			return -1;
 		}
-	
-		for (i = 1; i <= num; i++) {
-			if (send_tickle_ack(&dst, &src, 0, 0, 0)) {
-				fprintf(stderr, "Error while sending tickle ack from '%s' to '%s'\n",
-					addr1, addr2);
-				return -1;
-			}
-		}
+		w->nconns = 0;
+	}
+	for (c = 0; c < nconns; c++) {
+		struct tickle_worker *w = &workers[conn_shard(&conns[c], opts.threads)];
+		w->conns[w->nconns++] = conns[c];
+	}
+	free(conns);
 
+	clock_gettime(CLOCK_MONOTONIC, &opts.start);
+
+	for (i = 1; i < opts.threads; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]) == 0) {
+			workers[i].started = 1;
+		} else {
+			fprintf(stderr, "Failed to start worker %d, running it inline\n", i);
+			worker_run(&workers[i]);
+		}
 	}
-	return 0;
+	worker_run(&workers[0]);
+
+	/* only the main thread touches the totals */
+	for (i = 0; i < opts.threads; i++) {
+		if (workers[i].started)
+			pthread_join(workers[i].thread, NULL);
+		sent += workers[i].sent;
+		killed += workers[i].killed;
+		errors += workers[i].errors;
+		batch_free(&workers[i].b4);
+		batch_free(&workers[i].b6);
+		free(workers[i].conns);
+	}
+	free(workers);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	elapsed = ts_diff(&end, &opts.start);
+	if (verbose) {
+		fprintf(stderr, "tickle_tcp: %lu connections, %lu local sockets aborted,"
+			" %lu packets sent, %lu failed, %.6f s, %.0f pps, %d thread(s)\n",
+			(unsigned long)nconns, killed, sent - errors, errors, elapsed,
+			elapsed > 0 ? (sent - errors) / elapsed : 0.0, opts.threads);
+	}
+
+	return errors ? -1 : 0;
 }